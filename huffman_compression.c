@@ -2,861 +2,7153 @@
 *Author: Mary Rizkalla
 *Date:
 *
-* A script to compress and decompress a txt file utilising the Huffman encoding 
-* algorithim.
+* A script to compress and decompress any file, text or binary, utilising the 
+* Huffman encoding algorithim.
 *
+* Build: gcc -O2 -pthread huffman_compression.c -o huffman
+* Usage: huffman compress|decompress [options] [input|-]
+*        huffman test [options] [inputs...|-]
+*        huffman train [options] [samples...|-]
+*        huffman archive [options] [inputs...|-]
+*        huffman extract [options] archive [members...]
+*        huffman range [options] input offset length
+*        huffman list archive
+*        huffman benchmark [options] [files...]
+*        huffman benchmark-histogram
+*
+*******************************************************************************/
+
+/*******************************************************************************
+ * Header files
+*******************************************************************************/
+#define _POSIX_C_SOURCE 200809L /*clock_gettime, pread, pwrite and mmap*/
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+/*******************************************************************************
+ * Constants
+*******************************************************************************/
+#define MAX_CODE_LENGTH 32 /*longest huffman code the tables can represent*/
+#define MIN_CODE_LENGTH_LIMIT 8 /*shortest limit which fits 256 codes*/
+#define MAX_TREE_DEPTH 256 /*deepest leaf of a tree over 256 chars*/
+#define DECODE_ROOT_BITS 11 /*index width of the first level decode table*/
+#define BLOCK_SIZE (1 << 20) /*default input bytes compressed per block*/
+#define MIN_BLOCK_SIZE (1 << 12)
+#define MAX_BLOCK_SIZE (1 << 23) /*largest block accepted by the decoder*/
+#define MAX_THREADS 256
+#define BLOCKS_PER_THREAD 2 /*blocks read per batch for each thread*/
+#define PIPELINE_DEPTH 3 /*batches being read, coded and written at once*/
+#define SLOT_EMPTY 0
+#define SLOT_READ 1
+#define SLOT_CODED 2
+#define PAGE_TOUCH_STRIDE 4096 /*bytes between the reads which fault in the 
+pages of a mapped batch*/
+#define FILE_MAGIC "HUFZ" /*first bytes of every compressed file*/
+#define FILE_MAGIC_SIZE 4
+#define FORMAT_VERSION 1
+#define FILE_HEADER_SIZE 6 /*magic, version and flags*/
+#define FILE_FLAG_BLOCK_INDEX 1 /*a block index follows the end block*/
+#define FILE_FLAG_DICTIONARY 2 /*the ID of a trained table follows the header*/
+#define FILE_FLAG_CHECKSUMS 4 /*the header and each block are followed by a 
+CRC32C, of the header bytes and of the block's original bytes*/
+#define DICTIONARY_ID_SIZE 4
+#define CHECKSUM_SIZE 4
+#define CRC32C_POLYNOMIAL 0x82f63b78 /*Castagnoli, bit reversed*/
+#define CRC32C_SLICES 8 /*bytes the software checksum takes per step*/
+#define DICTIONARY_MAGIC "HUFD" /*first bytes of a trained table file*/
+#define DICTIONARY_HEADER_SIZE 9 /*magic, version and table ID*/
+#define DICTIONARY_NAME "trained.hufd" /*default name of a trained table*/
+#define ARCHIVE_MAGIC "HUFA" /*first bytes of an archive*/
+#define ARCHIVE_DIRECTORY_MAGIC "HUFC" /*last bytes of an archive*/
+#define ARCHIVE_ENTRY_SIZE 28 /*offset, compressed and uncompressed lengths and
+name length of a member, before its name*/
+#define ARCHIVE_FOOTER_SIZE 16 /*directory offset, member count and magic*/
+#define ARCHIVE_NAME "archive.hufa" /*default name of an archive*/
+#define MAX_MEMBER_NAME 4096 /*longest stored member name*/
+#define MAX_TRAINING_COUNT (1 << 22) /*sample counts are scaled below this so
+the tree's sums fit an int*/
+#define INDEX_MAGIC "HUFI" /*last bytes of a file with a block index*/
+#define INDEX_ENTRY_SIZE 20 /*offset, payload bits, length and table block*/
+#define INDEX_FOOTER_SIZE 16 /*index offset, block count and magic*/
+#define BLOCK_HEADER_SIZE 9 /*flags, uncompressed and payload lengths*/
+#define TABLE_BITMAP_SIZE 32 /*one bit per byte value present in a block*/
+#define TABLE_LENGTH_BITS 5 /*bits storing each code length minus one*/
+#define MAX_BLOCK_TABLE_SIZE (1 + TABLE_BITMAP_SIZE + \
+	(256*TABLE_LENGTH_BITS)/8)
+#define BLOCK_FLAG_REUSE_TABLE 1 /*block is coded with the previous table*/
+#define BLOCK_FLAG_FOUR_STREAMS 2 /*payload is split into interleaved streams*/
+#define STREAM_COUNT 4 /*streams of a block in four stream mode*/
+#define STREAM_JUMP_SIZE 12 /*byte lengths of all streams but the last*/
+#define MIN_STREAMS_LENGTH (1<<10) /*shorter blocks keep a single stream*/
+#define BLOCK_FLAG_ADAPTIVE 4 /*block is coded with the running adaptive codes*/
+#define BLOCK_FLAG_DICTIONARY 8 /*block is coded with the trained table*/
+#define BLOCK_FLAG_ORDER1 16 /*block is coded with tables picked by the byte 
+before each byte*/
+#define MAX_CONTEXT_GROUPS 16 /*order-1 tables of a block*/
+#define CONTEXT_MAP_SIZE 128 /*group of each previous byte, 4 bits each*/
+#define MAX_ORDER1_TABLES_SIZE (1 + CONTEXT_MAP_SIZE + \
+	MAX_CONTEXT_GROUPS*MAX_BLOCK_TABLE_SIZE)
+#define CONTEXT_PASSES 4 /*passes regrouping the previous bytes*/
+#define MIN_ORDER1_LENGTH (1 << 10) /*shorter blocks cannot pay for the map*/
+#define BLOCK_FLAG_RAW 32 /*payload is the block's bytes as they are*/
+#define BLOCK_FLAG_FILL 64 /*block repeats one byte, the whole payload*/
+#define ADAPTIVE_BLOCK_SIZE (1 << 16) /*largest adaptive block, each is written
+as soon as it is coded*/
+#define ADAPTIVE_CODE_LENGTH 16 /*longest adaptive code, bytes not seen yet 
+take the longest codes*/
+#define ADAPTIVE_FIRST_INTERVAL 256 /*bytes coded before the first rebuild*/
+#define ADAPTIVE_MAX_INTERVAL (1 << 14) /*the interval doubles up to this*/
+#define ADAPTIVE_COUNT_LIMIT (1 << 16) /*counts are halved above this total so
+the codes follow changes in the data*/
+#define HISTOGRAM_TABLES 8 /*interleaved count tables, one per byte of a word*/
+#define HISTOGRAM_CHUNK (1L << 30) /*bytes counted before the 32 bit counts
+are folded into the totals*/
+#define BENCHMARK_SIZE (1 << 26) /*bytes of each generated benchmark input*/
+#define FILE_EXTENSION ".huf" /*appended to the name of compressed files*/
+#define OUTPUT_EXTENSION ".out" /*appended when decompressing other names*/
+#define BENCHMARK_ROUNDS 8 /*passes timed over each benchmark input*/
+#define BENCHMARK_CORPUS_SIZE (1 << 24) /*bytes of each generated corpus input*/
+#define BENCHMARK_TINY_SIZE 256 /*bytes of the tiny corpus input*/
+#define BENCHMARK_ITERATIONS 5 /*default compress and decompress repetitions*/
+#define MAX_BENCHMARK_ITERATIONS 1000
+#define BENCHMARK_MIN_BYTES (1L << 22) /*small inputs repeat up to this much*/
+#define CORPUS_KINDS 6 /*text, logs, skewed, uniform, single and tiny*/
+
+/*******************************************************************************
+ * Structures
+*******************************************************************************/
+/*a node of the huffman tree. Nodes live in one flat array and refer to their
+children by index.*/
+struct node
+{
+	int freq;
+	int charIndex;
+	int largerFreq; /*index of the child node, -1 for leaf nodes*/
+	int smallerFreq;
+};
+typedef struct node node_t;
+
+struct key_value_pair
+{
+	unsigned char uniqueChar;
+	int codeLength; /*depth of the char in the huffman tree*/
+};
+typedef struct key_value_pair key_value_pair_t;
+
+/*the huffman code of a byte value, right aligned.*/
+struct symbol_code
+{
+	unsigned int code;
+	int length;
+};
+typedef struct symbol_code symbol_code_t;
+
+/*packs codes into a 64 bit accumulator which is flushed a word at a time.*/
+struct bit_writer
+{
+	uint64_t accumulator;
+	int bitCount; /*bits pending in the accumulator*/
+	unsigned char *buffer;
+	long position; /*bytes flushed to the buffer*/
+};
+typedef struct bit_writer bit_writer_t;
+
+/*serves the bits of a packed block payload from a 64 bit buffer.*/
+struct bit_reader
+{
+	uint64_t bitBuffer; /*next bits, left aligned*/
+	int bitCount; /*valid bits in bitBuffer, negative once overrun*/
+	const unsigned char *block;
+	long blockLength;
+	long blockPosition;
+};
+typedef struct bit_reader bit_reader_t;
+
+/*an entry of a decode table. A symbol entry has a non zero length, a link
+entry has a zero length and points to the next level table.*/
+struct decode_entry
+{
+	unsigned int value; /*symbol, or offset of the next level table*/
+	unsigned char length; /*bits consumed when the entry is a symbol*/
+	unsigned char subBits; /*index width of the next level table*/
+};
+typedef struct decode_entry decode_entry_t;
+
+/*multi level lookup tables indexed by the next bits of the bitstream.*/
+struct decode_table
+{
+	decode_entry_t *entries;
+	int entryCount;
+	int rootBits;
+	long capacity; /*bytes allocated for entries, kept between tables*/
+};
+typedef struct decode_table decode_table_t;
+
+/*a code left aligned in 32 bits, used to sort codes when building tables.*/
+struct decode_symbol
+{
+	unsigned int alignedCode;
+	int length;
+	unsigned char symbol;
+};
+typedef struct decode_symbol decode_symbol_t;
+
+/*the order-1 tables of a block. Each previous byte belongs to a group, and 
+the byte after it is coded with that group's table.*/
+struct order1_tables
+{
+	int groupCount; /*0 when the block is coded with a single table*/
+	unsigned char groups[256]; /*group of each previous byte*/
+	symbol_code_t codeTables[MAX_CONTEXT_GROUPS][256];
+	decode_table_t decodeTables[MAX_CONTEXT_GROUPS]; /*decoder only*/
+};
+typedef struct order1_tables order1_tables_t;
+
+/*a table trained on sample data, shared by the files compressed with it.*/
+struct dictionary
+{
+	uint32_t id; /*hash of the stored table, written in place of the table*/
+	symbol_code_t codeTable[256];
+	decode_table_t decodeTable;
+};
+typedef struct dictionary dictionary_t;
+
+/*settings of a compression or decompression job.*/
+struct compress_options
+{
+	int maxCodeLength; /*longest code the encoder may assign*/
+	int threadCount; /*threads compressing blocks in parallel*/
+	long blockSize; /*input bytes per block*/
+	int streamCount; /*bitstreams per block, 1 or STREAM_COUNT*/
+	int verbosity; /*0 quiet, 1 summary, 2 summary and code tables*/
+	int iterations; /*benchmark repetitions of each input*/
+	int stats; /*time the stages and print a JSON stats line per job*/
+	int adaptive; /*code with adaptive codes in one pass, no stored tables*/
+	const dictionary_t *dictionary; /*trained table for blocks, or NULL*/
+	int contextGroups; /*order-1 tables per block, 1 for a single table*/
+	int checksums; /*write a CRC32C after the header and each block*/
+};
+typedef struct compress_options compress_options_t;
+
+/*seconds spent in each stage of compressing and decompressing. Stages run 
+by the worker pool add up the time of every thread.*/
+struct stage_times
+{
+	double read;
+	double histogram;
+	double tree; /*createHuffmanTree*/
+	double codes; /*code lengths, canonical codes and decode tables*/
+	double encode;
+	double write;
+	double decode;
+};
+typedef struct stage_times stage_times_t;
+
+/*counters and stage timers of one compress, decompress or test job.*/
+struct job_stats
+{
+	stage_times_t times;
+	double seconds;
+	int64_t bytesIn;
+	int64_t bytesOut;
+	long blocks;
+	long tables;
+	int symbols; /*distinct byte values coded by any table*/
+	int maxCodeLength;
+	unsigned char seen[256];
+};
+typedef struct job_stats job_stats_t;
+
+/*the running byte counts of an adaptive stream. The encoder and decoder add 
+each coded segment to the counts and rebuild the same codes from them, so no
+table is stored.*/
+struct adaptive_model
+{
+	unsigned char symbols[256];
+	int counts[256]; /*every byte starts at one so every byte has a code*/
+	long total;
+	long interval; /*bytes coded between rebuilds*/
+	long untilRebuild;
+	symbol_code_t codeTable[256];
+};
+typedef struct adaptive_model adaptive_model_t;
+
+/*an input file. A named regular file is mapped whole and read in place, 
+other inputs such as pipes are read in large chunks into the caller's 
+buffer. Sizes and offsets are 64 bit so inputs may exceed 2 GB.*/
+struct input_source
+{
+	int fd;
+	const unsigned char *map; /*the mapped file, or NULL*/
+	int64_t size; /*file size, or -1 when the input cannot be read at offsets*/
+	int64_t position; /*offset of the next sequential read*/
+};
+typedef struct input_source input_source_t;
+
+/*the working state of one block while it is compressed.*/
+struct block_job
+{
+	const unsigned char *input; /*points into the map or the batch buffer*/
+	long inputLength;
+	unsigned char uniqueChars[256];
+	int charFreq[256];
+	int noOfUniqueChars;
+	symbol_code_t newTable[256]; /*table built from this block*/
+	symbol_code_t codeTable[256]; /*table the block is coded with*/
+	int reuseTable;
+	int dictionary; /*coded with the trained table, nothing stored*/
+	int storedAs; /*BLOCK_FLAG_RAW or BLOCK_FLAG_FILL when not coded, else 0*/
+	order1_tables_t order1; /*used instead of codeTable when groupCount > 0*/
+	uint32_t *pairCounts; /*counts of each byte after each byte, order-1 only*/
+	long limitCostBits;
+	unsigned char *out;
+	long outLength;
+	int streamCount;
+	long payloadBits;
+	stage_times_t times;
+	int status;
+};
+typedef struct block_job block_job_t;
+
+/*an entry of the block index written at the end of a compressed file.*/
+struct index_entry
+{
+	uint64_t offset; /*file offset of the block header*/
+	uint32_t payloadBits;
+	uint32_t blockLength;
+	uint32_t tableBlock; /*index of the block holding this block's table*/
+};
+typedef struct index_entry index_entry_t;
+
+/*the buffers of one block while it is decompressed from the index.*/
+struct decode_job
+{
+	long blockIndex;
+	unsigned char *payload; /*NULL when the payload is read from the map*/
+	unsigned char *decompressedOut;
+	decode_table_t decodeTable;
+	symbol_code_t codeTable[256]; /*the block's own table, if it has one*/
+	int ownTable; /*the block stores codeTable*/
+	order1_tables_t order1;
+	stage_times_t times;
+	int status;
+};
+typedef struct decode_job decode_job_t;
+
+/*the bytes from start up to end of the original of a compressed file.*/
+struct byte_range
+{
+	uint64_t start;
+	uint64_t end;
+};
+typedef struct byte_range byte_range_t;
+
+/*the blocks of an indexed file being decompressed by the worker pool.*/
+struct decompress_batch
+{
+	decode_job_t *jobs;
+	const index_entry_t *entries;
+	const uint64_t *outputOffsets;
+	long blockCount;
+	long maxPayloadLength;
+	const input_source_t *source;
+	int outFd; /*-1 to leave each block in its job's buffer*/
+	const byte_range_t *range; /*bytes wanted, or NULL for every block*/
+	int checksums; /*each block is followed by its checksum*/
+	const dictionary_t *dictionary;
+	int timed; /*time the stages of each block*/
+};
+typedef struct decompress_batch decompress_batch_t;
+
+/*the blocks of one batch and the settings they are compressed with.*/
+struct compress_batch
+{
+	block_job_t *jobs;
+	const compress_options_t *options;
+};
+typedef struct compress_batch compress_batch_t;
+
+/*a fixed set of threads which run the indexes of a task in parallel. The 
+calling thread takes part, so a pool of one thread starts no threads.*/
+struct worker_pool
+{
+	pthread_t threads[MAX_THREADS];
+	int threadCount;
+	pthread_mutex_t lock;
+	pthread_cond_t workReady;
+	pthread_cond_t workDone;
+	void (*task)(void *context, int index);
+	void *context;
+	int nextIndex;
+	int taskCount;
+	int completed;
+	long generation; /*counts the tasks run, wakes the workers*/
+	int shutdown;
+};
+typedef struct worker_pool worker_pool_t;
+
+/*the jobs, buffers and worker pool kept across the files of one run. The 
+buffers only grow, so once they fit the largest file the next files are 
+compressed and decompressed without allocating. Capacities are in bytes.*/
+struct codec_context
+{
+	worker_pool_t pool;
+	int poolThreads; /*threads of the running pool, 0 before it starts*/
+	block_job_t *blockJobs;
+	long blockJobsCapacity;
+	decode_job_t *decodeJobs;
+	long decodeJobsCapacity;
+	unsigned char *inputs; /*blocks read from unmapped input*/
+	long inputsCapacity;
+	unsigned char *outputs; /*encoded or decoded blocks*/
+	long outputsCapacity;
+	unsigned char *payloads; /*payloads read from unmapped input*/
+	long payloadsCapacity;
+	index_entry_t *entries;
+	long entriesCapacity;
+	uint64_t *outputOffsets;
+	long outputOffsetsCapacity;
+	uint32_t *pairCounts; /*byte pair counts of each order-1 block job*/
+	long pairCountsCapacity;
+	decode_table_t decodeTable; /*table of the sequential decoder*/
+	order1_tables_t order1; /*order-1 tables of the sequential decoder*/
+};
+typedef struct codec_context codec_context_t;
+
+/*a batch of blocks passing through the compress pipeline. The reader fills 
+an empty slot, the coding thread codes a read slot and the writer writes a 
+coded slot and empties it again.*/
+struct pipeline_slot
+{
+	block_job_t *jobs;
+	unsigned char *inputs; /*blocks read from unmapped input*/
+	int jobCount;
+	int last; /*the input ended in this batch*/
+	int state; /*SLOT_EMPTY, SLOT_READ or SLOT_CODED*/
+};
+typedef struct pipeline_slot pipeline_slot_t;
+
+/*the shared state of the reader, coding and writer threads of one stream. 
+Each field after the slots belongs to the one thread which uses it.*/
+struct compress_pipeline
+{
+	codec_context_t *context;
+	input_source_t *source;
+	FILE *fpOut;
+	const compress_options_t *options;
+	job_stats_t *stats;
+	int batchSize;
+	pipeline_slot_t slots[PIPELINE_DEPTH];
+	pthread_mutex_t lock;
+	pthread_cond_t changed; /*a slot changed state or the pipeline failed*/
+	int failed;
+	double readSeconds; /*reader*/
+	symbol_code_t codeTable[256]; /*coding thread, the last stored table*/
+	int hasTable;
+	int indexed; /*writer*/
+	long blockCount;
+	int64_t totalIn;
+	int64_t totalOut;
+	int64_t limitCostBits;
+	long tableBlock;
+};
+typedef struct compress_pipeline compress_pipeline_t;
+
+/*a file stored in an archive. name is the stored name, the path as given 
+without any leading /, ./ or ../.*/
+struct archive_member
+{
+	char *path; /*the input path when archiving, owns name*/
+	const char *name;
+	int64_t inputSize; /*size of a regular input file, or -1*/
+	uint64_t offset; /*archive offset of the member's compressed file*/
+	uint64_t compressedLength;
+	uint64_t length; /*uncompressed length*/
+};
+typedef struct archive_member archive_member_t;
+
+/*the members of an archive in archive order. Capacity is in bytes.*/
+struct archive_list
+{
+	archive_member_t *members;
+	long count;
+	long capacity;
+};
+typedef struct archive_list archive_list_t;
+
+/*a small member compressed into memory by one task of an archive batch.*/
+struct archive_job
+{
+	long member;
+	char *data;
+	size_t dataLength;
+	job_stats_t stats;
+	int status;
+};
+typedef struct archive_job archive_job_t;
+
+/*the state of an archive being written. Small members are compressed in 
+batches, one per task with its own context, and written in order.*/
+struct archive_batch
+{
+	archive_list_t *list;
+	worker_pool_t *pool; /*the pool running the batch*/
+	archive_job_t *jobs;
+	codec_context_t *contexts; /*one single threaded context per task*/
+	const compress_options_t *options; /*member options, one thread, quiet*/
+	FILE *fpOut;
+	uint64_t offset; /*archive offset of the next member*/
+	job_stats_t stats; /*totals over the members*/
+};
+typedef struct archive_batch archive_batch_t;
+
+/*******************************************************************************
+ * Function prototypes
+*******************************************************************************/
+int printUsage(void);
+
+int parseNumber(const char *text, long min, long max, long *value);
+
+int benchmarkHistogram(void);
+
+int benchmarkSuite(codec_context_t *context, char **fileNames, int fileCount, 
+	const compress_options_t *options);
+
+int benchmarkInput(codec_context_t *context, const char *name, 
+	const unsigned char *data, long length, const compress_options_t *options);
+
+int compressStages(codec_context_t *context, const unsigned char *data, 
+	long length, const compress_options_t *options, FILE *fpOut, 
+	stage_times_t *times);
+
+void startTimer(struct timespec *clock);
+
+void lapTimer(struct timespec *clock, double *stageSeconds);
+
+void addStageTimes(stage_times_t *total, const stage_times_t *times);
+
+void addTableStats(job_stats_t *stats, const symbol_code_t codeTable[256]);
+
+void printStats(const char *command, const char *inputName, 
+	const job_stats_t *stats, const compress_options_t *options, int status);
+
+void printJsonString(FILE *fp, const char *text);
+
+void generateCorpus(int kind, unsigned char *data, long length);
+
+uint64_t nextRandom(uint64_t *state);
+
+double throughput(long length, long rounds, double seconds);
+
+long peakMemory(void);
+
+double secondsSince(const struct timespec *start);
+
+int compressFile(codec_context_t *context, const char *inputName, 
+	const char *outputName, const compress_options_t *options);
+
+int compressStream(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats);
+
+int compressAdaptive(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats);
+
+int readBatch(compress_pipeline_t *pipeline, pipeline_slot_t *slot);
+
+int codeBatch(compress_pipeline_t *pipeline, pipeline_slot_t *slot);
+
+int writeBatch(compress_pipeline_t *pipeline, pipeline_slot_t *slot);
+
+void *readerMain(void *argument);
+
+void *writerMain(void *argument);
+
+pipeline_slot_t *waitForSlot(compress_pipeline_t *pipeline, long sequence, 
+	int state);
+
+void setSlotState(compress_pipeline_t *pipeline, pipeline_slot_t *slot, 
+	int state);
+
+void failPipeline(compress_pipeline_t *pipeline);
+
+long writeFileHeader(FILE *fpOut, int flags, const dictionary_t *dictionary);
+
+int trainDictionary(char **inputNames, int inputCount, const char *outputName,
+	const compress_options_t *options);
+
+int loadDictionary(const char *name, dictionary_t *dictionary);
+
+uint32_t tableId(const unsigned char *table, long length);
+
+int createArchive(codec_context_t *context, char **inputNames, int inputCount,
+	const char *outputName, const compress_options_t *options);
+
+int compressArchiveBatch(archive_batch_t *batch, int jobCount);
+
+void compressMemberTask(void *context, int index);
+
+int compressMember(codec_context_t *context, const char *inputName, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats);
+
+int addArchiveInput(archive_list_t *list, const char *name);
+
+int addArchivePath(archive_list_t *list, const char *name, int top);
+
+int addArchiveDirectory(archive_list_t *list, const char *name);
+
+int addArchiveMember(archive_list_t *list, const char *path, 
+	int64_t inputSize);
+
+int compareNames(const void *a, const void *b);
+
+long writeArchiveDirectory(FILE *fpOut, const archive_list_t *list, 
+	uint64_t directoryOffset);
+
+int extractArchive(codec_context_t *context, const char *archiveName, 
+	char **memberNames, int memberCount, const char *outputDirectory, 
+	const compress_options_t *options);
+
+int extractMember(codec_context_t *context, const input_source_t *archive, 
+	const archive_member_t *member, const char *outputDirectory, 
+	const compress_options_t *options);
+
+int decompressMember(codec_context_t *context, const input_source_t *archive, 
+	const archive_member_t *member, FILE *fpOut, 
+	const compress_options_t *options);
+
+int listArchive(const char *archiveName);
+
+int readArchiveDirectory(const input_source_t *source, archive_list_t *list);
+
+int memberNameSafe(const char *name);
+
+int makeParentDirectories(char *path);
+
+void freeArchiveList(archive_list_t *list);
+
+void addJobStats(job_stats_t *total, const job_stats_t *stats);
+
+void analyseBlockTask(void *context, int index);
+
+void encodeBlockTask(void *context, int index);
+
+int analyseBlock(block_job_t *job, const compress_options_t *options);
+
+int chooseBlockCoding(block_job_t *job, const compress_options_t *options);
+
+int singleTable(const block_job_t *job);
+
+long estimateBits(const block_job_t *job);
+
+long codedBits(const block_job_t *job, const symbol_code_t codeTable[256]);
+
+int trainedTableFits(const block_job_t *job, const symbol_code_t *codeTable);
+
+void countBlock(block_job_t *job, const compress_options_t *options);
+
+int buildBlockCodes(block_job_t *job, const compress_options_t *options);
+
+int buildOrder1Tables(block_job_t *job, const compress_options_t *options);
+
+void countPairs(const block_job_t *job, uint32_t *pairs);
+
+float fastLog2(float value);
+
+long maxBlockOutputSize(long blockSize);
+
+void chooseBlockTable(block_job_t *job, const symbol_code_t *previousTable);
+
+void encodeBlock(block_job_t *job);
+
+void appendBlockChecksum(block_job_t *job);
+
+long encodeAdaptive(adaptive_model_t *model, const unsigned char *input, 
+	long inputLength, unsigned char *out);
+
+int initAdaptiveModel(adaptive_model_t *model, decode_table_t *table);
+
+int adaptModel(adaptive_model_t *model, const unsigned char *segment, 
+	long length, decode_table_t *table);
+
+void initContext(codec_context_t *context);
+
+void destroyContext(codec_context_t *context);
+
+int reserveBuffer(void *buffer, long *capacity, long size);
+
+int reserveWorkerPool(codec_context_t *context, int threadCount);
+
+int initWorkerPool(worker_pool_t *pool, int threadCount);
+
+void *workerMain(void *argument);
+
+void runWorkerPool(worker_pool_t *pool, void (*task)(void *, int), 
+	void *context, int taskCount);
+
+void runTaskIndexes(worker_pool_t *pool);
+
+void destroyWorkerPool(worker_pool_t *pool);
+
+int generateHuffmanCodes(unsigned char *uniqueChars, int *charFreq, 
+	const int noOfUniqueChars, symbol_code_t codeTable[256], 
+	const int maxCodeLength, long *limitCostBits, stage_times_t *times);
+
+int uniqueCharsFreqCounter(const unsigned char *inputString, 
+	long inputStringLength, unsigned char *uniqueChars, int *charFreq);
+
+void byteHistogram(const unsigned char *data, long length, 
+	uint64_t freq[256]);
+
+int createHuffmanTree(node_t nodeArray[], const int *charFreq, 
+	const int noOfUniqueChars);
+
+int compareFreqKeys(const void *a, const void *b);
+
+int nextSmallestIndex(const node_t nodeArray[], const uint64_t *leafOrder, 
+	int *leafFront, const int noOfUniqueChars, int *internalFront, 
+	const int internalEnd);
+
+void preorderGenerationOfHuffmanCode(const node_t nodeArray[], int tree, 
+	int codeIndex, const int noOfUniqueChars, key_value_pair_t *codeArray[]);
+
+long limitCodeLengths(key_value_pair_t *codeArray[], const int *charFreq, 
+	const int noOfUniqueChars, const int maxCodeLength);
+
+int assignCanonicalCodes(symbol_code_t codeTable[256]);
+
+long writeBlockTable(const symbol_code_t codeTable[256], unsigned char *out);
+
+long blockTableSize(const int noOfUniqueChars);
+
+long writeOrder1Tables(const order1_tables_t *order1, unsigned char *out);
+
+void printHuffmanCodes(const symbol_code_t codeTable[256]);
+
+void buildCodeTable(key_value_pair_t *codeArray[], const int noOfUniqueChars, 
+	symbol_code_t codeTable[256]);
+
+void storeU32(unsigned char *buffer, uint32_t value);
+
+uint32_t loadU32(const unsigned char *buffer);
+
+void storeU64(unsigned char *buffer, uint64_t value);
+
+uint64_t loadU64(const unsigned char *buffer);
+
+uint32_t crc32c(uint32_t crc, const unsigned char *data, long length);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+uint32_t crc32cHardware(uint32_t crc, const unsigned char *data, long length);
+#endif
+
+uint32_t crc32cSoftware(uint32_t crc, const unsigned char *data, long length);
+
+void initCrc32cTables(void);
+
+void storeWordBigEndian(unsigned char *buffer, uint64_t word);
+
+void writeBits(bit_writer_t *writer, unsigned int code, int length);
+
+void flushBits(bit_writer_t *writer);
+
+long encodeString(const unsigned char *inputString, long inputStringLength, 
+	const symbol_code_t codeTable[256], bit_writer_t *writer);
+
+long encodeOrder1String(const unsigned char *inputString, 
+	long inputStringLength, const symbol_code_t *const codeTables[256], 
+	bit_writer_t *writer);
+
+int buildDecodeTable(const unsigned char *symbols, const unsigned int *codes,
+	const int *codeLengths, const int noOfUniqueChars, decode_table_t *table);
+
+int buildCodeDecodeTable(const symbol_code_t codeTable[256], 
+	decode_table_t *table);
+
+int compareDecodeSymbols(const void *a, const void *b);
+
+int fillDecodeLevel(decode_table_t *table, const decode_symbol_t *symbols, 
+	int count, int prefixLength, int tableOffset, int tableBits);
+
+void freeDecodeTable(decode_table_t *table);
+
+void freeOrder1Tables(order1_tables_t *order1);
+
+void initBitReader(bit_reader_t *reader, const unsigned char *block, 
+	long blockLength);
+
+uint64_t loadWordBigEndian(const unsigned char *buffer);
+
+static inline void refillBits(bit_reader_t *reader);
+
+unsigned int readBits(bit_reader_t *reader, int count);
+
+static inline int decodeSymbol(bit_reader_t *reader, 
+	const decode_table_t *table);
+
+long decodeString(bit_reader_t *reader, unsigned char *decompressedOut, 
+	long decompressedOutLength, const decode_table_t *table);
+
+int decodeStreams(const unsigned char *payload, long payloadLength, 
+	unsigned char *decompressedOut, long decompressedOutLength, 
+	const decode_table_t *table);
+
+int openStreams(const unsigned char *payload, long payloadLength, 
+	bit_reader_t readers[STREAM_COUNT]);
+
+long decodeOrder1String(bit_reader_t *reader, unsigned char *decompressedOut,
+	long decompressedOutLength, const decode_table_t *const tables[256], 
+	int previous);
+
+int decodeOrder1Block(int blockFlags, const unsigned char *payload, 
+	long payloadLength, unsigned char *decompressedOut, long blockLength, 
+	const order1_tables_t *order1);
+
+int decodeBlockRange(int blockFlags, const unsigned char *payload, 
+	long payloadLength, unsigned char *decompressedOut, long blockLength, 
+	const decode_table_t *table, const order1_tables_t *order1, long start, 
+	long end);
+
+int decodeBlock(int blockFlags, const unsigned char *payload, 
+	long payloadLength, unsigned char *decompressedOut, long blockLength, 
+	const decode_table_t *table, const order1_tables_t *order1);
+
+int storedBlockValid(int blockFlags, long payloadLength, long blockLength);
+
+int decodeAdaptive(adaptive_model_t *model, decode_table_t *table, 
+	const unsigned char *payload, long payloadLength, 
+	unsigned char *decompressedOut, long blockLength);
+
+int writeBlockIndex(FILE *fpOut, const index_entry_t *entries, 
+	long blockCount, uint64_t indexOffset);
+
+int decompressFile(codec_context_t *context, const char *inputName, 
+	const char *outputName, const compress_options_t *options);
+
+int testInput(codec_context_t *context, const char *inputName, 
+	const compress_options_t *options);
+
+int decompressSource(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats);
+
+int decompressStream(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, int flags, const compress_options_t *options, 
+	const byte_range_t *range, job_stats_t *stats);
+
+int decompressRange(codec_context_t *context, const char *inputName, 
+	const char *outputName, const byte_range_t *range, 
+	const compress_options_t *options);
+
+int decompressIndexedRange(codec_context_t *context, 
+	const input_source_t *source, FILE *fpOut, int flags, 
+	const byte_range_t *range, const compress_options_t *options, 
+	job_stats_t *stats);
+
+int decompressIndexed(codec_context_t *context, const input_source_t *source,
+	FILE *fpOut, int flags, const compress_options_t *options, 
+	job_stats_t *stats);
+
+int readBlockIndex(codec_context_t *context, const input_source_t *source, 
+	long *blockCount);
+
+void decodeIndexedBlockTask(void *context, int index);
+
+int decodeIndexedBlock(decompress_batch_t *batch, decode_job_t *job);
+
+int checkIndexedBlock(const decompress_batch_t *batch, const decode_job_t *job,
+	uint64_t offset, long blockLength);
+
+int readIndexedTable(const input_source_t *source, uint64_t offset, 
+	decode_table_t *table, symbol_code_t codeTable[256]);
+
+long readIndexedOrder1Tables(const input_source_t *source, uint64_t offset, 
+	order1_tables_t *order1);
+
+int isRegularFile(FILE *fp);
+
+int readFileHeader(input_source_t *source, const compress_options_t *options,
+	int *flags);
+
+int readBlockTable(input_source_t *source, decode_table_t *table, 
+	symbol_code_t codeTable[256]);
+
+long parseBlockTable(const unsigned char *data, long available, 
+	decode_table_t *table, symbol_code_t codeTable[256]);
+
+int readOrder1Tables(input_source_t *source, order1_tables_t *order1);
+
+long parseOrder1Tables(const unsigned char *data, long available, 
+	order1_tables_t *order1);
+
+int parseContextMap(const unsigned char *data, order1_tables_t *order1);
+
+char *defaultOutputName(const char *inputName, int compressing);
+
+int openInputSource(input_source_t *source, const char *name);
+
+long readInput(input_source_t *source, unsigned char *buffer, long length, 
+	const unsigned char **data);
+
+long readAvailable(input_source_t *source, unsigned char *buffer, long length,
+	const unsigned char **data);
+
+long readInputAt(const input_source_t *source, unsigned char *buffer, 
+	long length, uint64_t offset, const unsigned char **data);
+
+void closeInputSource(input_source_t *source);
+
+void memoryInputSource(input_source_t *source, const unsigned char *data, 
+	long length);
+
+FILE *openOutput(const char *name);
+
+int closeFiles(input_source_t *source, FILE *fpOut, const char *outputName, 
+	int status);
+
+/*******************************************************************************
+ * Global variables
+*******************************************************************************/
+/*the software checksum tables, built by the first thread which needs them.*/
+uint32_t crc32cTables[CRC32C_SLICES][256];
+pthread_once_t crc32cTablesOnce = PTHREAD_ONCE_INIT;
+
+
+/*******************************************************************************
+ * Main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+	compress_options_t options;
+	options.maxCodeLength = MAX_CODE_LENGTH;
+	options.threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(options.threadCount < 1)
+	{
+		options.threadCount = 1;
+	}
+	if(options.threadCount > MAX_THREADS)
+	{
+		options.threadCount = MAX_THREADS;
+	}
+	options.blockSize = BLOCK_SIZE;
+	options.streamCount = STREAM_COUNT;
+	options.verbosity = 1;
+	options.iterations = BENCHMARK_ITERATIONS;
+	options.stats = 0;
+	options.adaptive = 0;
+	options.dictionary = NULL;
+	options.contextGroups = 1;
+	options.checksums = 0;
+	if(argc < 2)
+	{
+		printUsage();
+		return 2;
+	}
+
+	/****the options follow the command, so argv[1] stands in for argv[0].****/
+	const char *command = argv[1];
+	const char *outputName = NULL;
+	const char *dictionaryName = NULL;
+	long value;
+	int option;
+	while((option = getopt(argc - 1, &argv[1], "o:d:l:t:b:s:c:n:akjqv")) != -1)
+	{
+		switch(option)
+		{
+			case 'o':	outputName = optarg;
+						break;
+			case 'd':	dictionaryName = optarg;
+						break;
+			case 'l':	if(parseNumber(optarg, MIN_CODE_LENGTH_LIMIT, 
+							MAX_CODE_LENGTH, &value))
+						{
+							fprintf(stderr, "Invalid code length.\n");
+							return 2;
+						}
+						options.maxCodeLength = (int)value;
+						break;
+			case 't':	if(parseNumber(optarg, 1, MAX_THREADS, &value))
+						{
+							fprintf(stderr, "Invalid number of threads.\n");
+							return 2;
+						}
+						options.threadCount = (int)value;
+						break;
+			case 'b':	if(parseNumber(optarg, MIN_BLOCK_SIZE >> 10, 
+							MAX_BLOCK_SIZE >> 10, &value))
+						{
+							fprintf(stderr, "Invalid block size.\n");
+							return 2;
+						}
+						options.blockSize = value << 10;
+						break;
+			case 's':	if(parseNumber(optarg, 1, STREAM_COUNT, &value) || 
+							(value != 1 && value != STREAM_COUNT))
+						{
+							fprintf(stderr, "Invalid number of streams.\n");
+							return 2;
+						}
+						options.streamCount = (int)value;
+						break;
+			case 'c':	if(parseNumber(optarg, 1, MAX_CONTEXT_GROUPS, &value))
+						{
+							fprintf(stderr, "Invalid number of context "
+								"groups.\n");
+							return 2;
+						}
+						options.contextGroups = (int)value;
+						break;
+			case 'n':	if(parseNumber(optarg, 1, MAX_BENCHMARK_ITERATIONS, 
+							&value))
+						{
+							fprintf(stderr, "Invalid number of iterations.\n");
+							return 2;
+						}
+						options.iterations = (int)value;
+						break;
+			case 'a':	options.adaptive = 1;
+						break;
+			case 'k':	options.checksums = 1;
+						break;
+			case 'j':	options.stats = 1;
+						break;
+			case 'q':	options.verbosity = 0;
+						break;
+			case 'v':	options.verbosity = 2;
+						break;
+			default :	printUsage();
+						return 2;
+		}
+	}
+	int inputCount = argc - 1 - optind;
+	if(inputCount > 1 && strcmp(command, "benchmark") != 0 && 
+		strcmp(command, "train") != 0 && strcmp(command, "archive") != 0 && 
+		strcmp(command, "extract") != 0 && strcmp(command, "range") != 0 && 
+		strcmp(command, "test") != 0)
+	{
+		printUsage();
+		return 2;
+	}
+	const char *inputName = inputCount == 1 ? argv[1 + optind] : "-";
+	if(dictionaryName != NULL && options.adaptive)
+	{
+		fprintf(stderr, "Adaptive mode cannot use a trained table.\n");
+		return 2;
+	}
+	if(options.contextGroups > 1 && options.adaptive)
+	{
+		fprintf(stderr, "Adaptive mode cannot use order-1 tables.\n");
+		return 2;
+	}
+	dictionary_t dictionary;
+	memset(&dictionary, 0, sizeof(dictionary));
+	if(dictionaryName != NULL)
+	{
+		if(loadDictionary(dictionaryName, &dictionary))
+		{
+			return 1;
+		}
+		options.dictionary = &dictionary;
+	}
+
+	/****run the command, naming the output after the input if not given. 
+	The jobs share one context for their buffers and threads.****/
+	codec_context_t context;
+	initContext(&context);
+	int status;
+	char *defaultName = NULL;
+	if(strcmp(command, "benchmark") == 0)
+	{
+		status = benchmarkSuite(&context, &argv[1 + optind], inputCount, 
+			&options);
+	}
+	else if(strcmp(command, "compress") == 0 || 
+		strcmp(command, "decompress") == 0)
+	{
+		int compressing = command[0] == 'c';
+		if(outputName == NULL)
+		{
+			defaultName = defaultOutputName(inputName, compressing);
+			outputName = defaultName;
+		}
+		if(outputName == NULL)
+		{
+			fprintf(stderr, "Memory allocation error.\n");
+			status = 1;
+		}
+		else
+		{
+			status = compressing ? 
+				compressFile(&context, inputName, outputName, &options) : 
+				decompressFile(&context, inputName, outputName, &options);
+		}
+	}
+	else if(strcmp(command, "test") == 0)
+	{
+		char *stdinName[1] = {"-"};
+		char **inputNames = inputCount > 0 ? &argv[1 + optind] : stdinName;
+		int i;
+		status = 0;
+		for(i=0; i<(inputCount > 0 ? inputCount : 1); i++)
+		{
+			status |= testInput(&context, inputNames[i], &options);
+		}
+	}
+	else if(strcmp(command, "train") == 0)
+	{
+		char *stdinName[1] = {"-"};
+		status = trainDictionary(inputCount > 0 ? &argv[1 + optind] : 
+			stdinName, inputCount > 0 ? inputCount : 1, 
+			outputName != NULL ? outputName : DICTIONARY_NAME, &options);
+	}
+	else if(strcmp(command, "archive") == 0)
+	{
+		char *stdinName[1] = {"-"};
+		status = createArchive(&context, inputCount > 0 ? &argv[1 + optind] : 
+			stdinName, inputCount > 0 ? inputCount : 1, 
+			outputName != NULL ? outputName : ARCHIVE_NAME, &options);
+	}
+	else if(strcmp(command, "extract") == 0 && inputCount > 0)
+	{
+		status = extractArchive(&context, argv[1 + optind], &argv[2 + optind], 
+			inputCount - 1, outputName != NULL ? outputName : ".", &options);
+	}
+	else if(strcmp(command, "range") == 0 && inputCount == 3)
+	{
+		long offset;
+		long length;
+		if(parseNumber(argv[2 + optind], 0, LONG_MAX, &offset) || 
+			parseNumber(argv[3 + optind], 0, LONG_MAX, &length))
+		{
+			fprintf(stderr, "Invalid range.\n");
+			status = 2;
+		}
+		else
+		{
+			byte_range_t range;
+			range.start = (uint64_t)offset;
+			range.end = (uint64_t)offset + (uint64_t)length;
+			status = decompressRange(&context, argv[1 + optind], 
+				outputName != NULL ? outputName : "-", &range, &options);
+		}
+	}
+	else if(strcmp(command, "list") == 0 && inputCount == 1)
+	{
+		status = listArchive(inputName);
+	}
+	else if(strcmp(command, "benchmark-histogram") == 0)
+	{
+		status = benchmarkHistogram();
+	}
+	else
+	{
+		printUsage();
+		status = 2;
+	}
+	destroyContext(&context);
+	freeDecodeTable(&dictionary.decodeTable);
+	free(defaultName);
+
+	return status;
+}
+
+/*******************************************************************************
+ * This function prints the command line usage.
+*******************************************************************************/
+int printUsage(void)
+{
+	fprintf(stderr, 
+		"usage: huffman compress [options] [input|-]\n"
+		"       huffman decompress [options] [input|-]\n"
+		"       huffman test [options] [inputs...|-]\n"
+		"       huffman train [options] [samples...|-]\n"
+		"       huffman archive [options] [inputs...|-]\n"
+		"       huffman extract [options] archive [members...]\n"
+		"       huffman range [options] input offset length\n"
+		"       huffman list archive\n"
+		"       huffman benchmark [options] [files...]\n"
+		"       huffman benchmark-histogram\n"
+		"\n"
+		"  -o file     output file, - for stdout (default input%s, or the\n"
+		"              input without %s when decompressing; stdout for stdin;\n"
+		"              %s when training, %s when\n"
+		"              archiving); the directory to extract into (default .)\n"
+		"  -d table    code blocks with a table made by train, which is also\n"
+		"              needed to decompress\n"
+		"  -l bits     maximum code length, %d-%d (default %d)\n"
+		"  -t threads  worker threads, 1-%d (default: online cpus)\n"
+		"  -b KB       block size, %d-%d (default %d)\n"
+		"  -s streams  bitstreams per block, 1 or %d (default %d)\n"
+		"  -c groups   order-1 tables per block, the byte before each byte\n"
+		"              picks its table, 1-%d (default 1); a block keeps one\n"
+		"              table when that codes it smaller\n"
+		"  -n count    benchmark iterations, 1-%d (default %d)\n"
+		"  -a          adaptive, code in one pass from running counts with no\n"
+		"              stored tables, flushing each block (for live streams)\n"
+		"  -k          checksum the header and each block with CRC32C\n"
+		"  -j          print stage timings and counts as JSON on stderr\n"
+		"  -q          quiet, print errors only\n"
+		"  -v          verbose, also print the code tables\n"
+		"\n"
+		"benchmark times each stage on one thread over the given files, or a\n"
+		"generated corpus without files. train builds a table for -d from\n"
+		"sample files of the data to be compressed. archive compresses files,\n"
+		"and the files under directories, into one archive with a directory\n"
+		"of its members, - reads the names from stdin; extract restores all\n"
+		"or only the named members. range writes length bytes from offset of\n"
+		"the original of a compressed file (default stdout), decoding only\n"
+		"the blocks they lie in when the file has a block index. test decodes\n"
+		"files, and the members of archives, checking their checksums\n"
+		"without writing anything.\n", 
+		FILE_EXTENSION, FILE_EXTENSION, DICTIONARY_NAME, ARCHIVE_NAME, 
+		MIN_CODE_LENGTH_LIMIT, MAX_CODE_LENGTH, MAX_CODE_LENGTH, MAX_THREADS, 
+		MIN_BLOCK_SIZE >> 10, MAX_BLOCK_SIZE >> 10, BLOCK_SIZE >> 10, 
+		STREAM_COUNT, STREAM_COUNT, MAX_CONTEXT_GROUPS, 
+		MAX_BENCHMARK_ITERATIONS, BENCHMARK_ITERATIONS);
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function parses a whole decimal argument within the given range.
+*******************************************************************************/
+int parseNumber(const char *text, long min, long max, long *value)
+{
+	char *end;
+	*value = strtol(text, &end, 10);
+
+	return end == text || *end != '\0' || *value < min || *value > max;
+}
+
+/*******************************************************************************
+ * This function times the histogram over generated uniform, skewed and single
+ * byte inputs and prints its throughput next to a single table count.
+*******************************************************************************/
+int benchmarkHistogram(void)
+{
+	unsigned char *data = malloc(sizeof(unsigned char)*BENCHMARK_SIZE);
+	if(data == NULL)
+	{
+		fprintf(stderr, "Cannot run benchmark. Memory allocation error.\n");
+		return 1;
+	}
+
+	const char *names[3] = {"uniform", "skewed", "single byte"};
+	const int kinds[3] = {3, 2, 4};
+	printf("\n>Benchmarking histogram over %d MB inputs\n...\n", 
+		BENCHMARK_SIZE >> 20);
+	int input;
+	for(input=0; input<3; input++)
+	{
+		generateCorpus(kinds[input], data, BENCHMARK_SIZE);
+		long i;
+
+		uint64_t freq[256];
+		uint32_t singleFreq[256];
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		int round;
+		for(round=0; round<BENCHMARK_ROUNDS; round++)
+		{
+			byteHistogram(data, BENCHMARK_SIZE, freq);
+		}
+		double tableSeconds = secondsSince(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(round=0; round<BENCHMARK_ROUNDS; round++)
+		{
+			memset(singleFreq, 0, sizeof(singleFreq));
+			for(i=0; i<BENCHMARK_SIZE; i++)
+			{
+				singleFreq[data[i]]++;
+			}
+		}
+		double singleSeconds = secondsSince(&start);
+
+		/*check the kernels agree so neither is optimised away.*/
+		for(i=0; i<256; i++)
+		{
+			if(freq[i] != singleFreq[i])
+			{
+				fprintf(stderr, "Histogram mismatch on byte %ld.\n", i);
+				free(data);
+				return 1;
+			}
+		}
+
+		double gigabytes = (double)BENCHMARK_SIZE*BENCHMARK_ROUNDS/1e9;
+		printf(" - %-11s %d tables: %6.2f GB/s, 1 table: %6.2f GB/s\n", 
+			names[input], HISTOGRAM_TABLES, gigabytes/tableSeconds, 
+			gigabytes/singleSeconds);
+	}
+
+	free(data);
+	return 0;
+}
+
+/*******************************************************************************
+ * This function benchmarks the given files, or the generated corpus when no 
+ * files are given, printing one row of stage throughputs per input.
+*******************************************************************************/
+int benchmarkSuite(codec_context_t *context, char **fileNames, int fileCount, 
+	const compress_options_t *options)
+{
+	const char *corpusNames[CORPUS_KINDS] = {"text", "logs", "skewed", 
+		"uniform", "single", "tiny"};
+	printf("%d KB blocks, %d streams, %d bit codes, %d context groups, "
+		"%d iterations, 1 thread\n", (int)((*options).blockSize >> 10), 
+		(*options).streamCount, (*options).maxCodeLength, 
+		(*options).contextGroups, (*options).iterations);
+	printf("%-16s %10s %7s %9s %9s %9s %9s %9s %8s\n", "input", "bytes", 
+		"ratio", "hist MB/s", "tree MB/s", "enc MB/s", "wrt MB/s", 
+		"dec MB/s", "peak MB");
+
+	int status = 0;
+	int i;
+	for(i=0; i<(fileCount > 0 ? fileCount : CORPUS_KINDS); i++)
+	{
+		if(fileCount == 0)
+		{
+			long length = i == CORPUS_KINDS - 1 ? BENCHMARK_TINY_SIZE : 
+				BENCHMARK_CORPUS_SIZE;
+			unsigned char *data = malloc(sizeof(unsigned char)*length);
+			if(data == NULL)
+			{
+				fprintf(stderr, "Cannot run benchmark. Memory allocation "
+					"error.\n");
+				return 1;
+			}
+			generateCorpus(i, data, length);
+			status |= benchmarkInput(context, corpusNames[i], data, length, 
+				options);
+			free(data);
+			continue;
+		}
+
+		/****files are benchmarked straight from their map.****/
+		input_source_t source;
+		if(openInputSource(&source, fileNames[i]))
+		{
+			status = 1;
+			continue;
+		}
+		if(source.map == NULL)
+		{
+			fprintf(stderr, "Cannot benchmark %s, it is empty or not a "
+				"regular file.\n", fileNames[i]);
+			status = 1;
+		}
+		else
+		{
+			status |= benchmarkInput(context, fileNames[i], source.map, 
+				(long)source.size, options);
+		}
+		closeInputSource(&source);
+	}
+
+	return status;
+}
+
+/*******************************************************************************
+ * This function compresses and decompresses one input in memory for the set 
+ * number of iterations, timing each stage, checks the round trip and prints 
+ * the input's row. Small inputs are repeated until enough bytes are timed.
+*******************************************************************************/
+int benchmarkInput(codec_context_t *context, const char *name, 
+	const unsigned char *data, long length, const compress_options_t *options)
+{
+	long rounds = (*options).iterations;
+	if(length*rounds < BENCHMARK_MIN_BYTES)
+	{
+		rounds = BENCHMARK_MIN_BYTES/length;
+	}
+
+	stage_times_t times;
+	memset(&times, 0, sizeof(times));
+	int status = 0;
+	size_t compressedLength = 0;
+	long round;
+	for(round=0; round<rounds && !status; round++)
+	{
+		char *compressed = NULL;
+		FILE *fpOut = open_memstream(&compressed, &compressedLength);
+		if(fpOut == NULL)
+		{
+			fprintf(stderr, "Cannot run benchmark. Memory allocation error.\n");
+			return 1;
+		}
+		status = compressStages(context, data, length, options, fpOut, &times);
+		if(fclose(fpOut) != 0)
+		{
+			status = 1;
+		}
+
+		/****time the decoder alone, then check its output once.****/
+		input_source_t source;
+		int flags;
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		memoryInputSource(&source, (unsigned char *)compressed, 
+			(long)compressedLength);
+		job_stats_t stats;
+		memset(&stats, 0, sizeof(stats));
+		status = status || readFileHeader(&source, options, &flags) || 
+			decompressStream(context, &source, NULL, flags, options, NULL, 
+			&stats);
+		times.decode += secondsSince(&start);
+		if(!status && round == 0)
+		{
+			char *decompressed = NULL;
+			size_t decompressedLength = 0;
+			fpOut = open_memstream(&decompressed, &decompressedLength);
+			memoryInputSource(&source, (unsigned char *)compressed, 
+				(long)compressedLength);
+			status = fpOut == NULL || 
+				readFileHeader(&source, options, &flags) || 
+				decompressStream(context, &source, fpOut, flags, options, 
+				NULL, &stats);
+			if(fpOut != NULL && fclose(fpOut) != 0)
+			{
+				status = 1;
+			}
+			if(!status && ((long)decompressedLength != length || 
+				memcmp(decompressed, data, length) != 0))
+			{
+				fprintf(stderr, "Benchmark round trip of %s differs.\n", name);
+				status = 1;
+			}
+			free(decompressed);
+		}
+		free(compressed);
+	}
+	if(status)
+	{
+		return 1;
+	}
+
+	printf("%-16.16s %10ld %6.2f%% %9.1f %9.1f %9.1f %9.1f %9.1f %8.1f\n", 
+		name, length, 100.0*compressedLength/length, 
+		throughput(length, rounds, times.histogram), 
+		throughput(length, rounds, times.tree), 
+		throughput(length, rounds, times.encode), 
+		throughput(length, rounds, times.write), 
+		throughput(length, rounds, times.decode), peakMemory()/1048576.0);
+	return 0;
+}
+
+/*******************************************************************************
+ * This function compresses an input held in memory block by block on the 
+ * calling thread, adding the time of each stage to the totals. The stream has
+ * no block index.
+*******************************************************************************/
+int compressStages(codec_context_t *context, const unsigned char *data, 
+	long length, const compress_options_t *options, FILE *fpOut, 
+	stage_times_t *times)
+{
+	if(reserveBuffer(&(*context).blockJobs, &(*context).blockJobsCapacity, 
+		sizeof(block_job_t)) || reserveBuffer(&(*context).outputs, 
+		&(*context).outputsCapacity, maxBlockOutputSize((*options).blockSize)) 
+		|| ((*options).contextGroups > 1 && reserveBuffer(
+		&(*context).pairCounts, &(*context).pairCountsCapacity, 
+		sizeof(uint32_t)*256*256)))
+	{
+		fprintf(stderr, "Cannot run benchmark. Memory allocation error.\n");
+		return 1;
+	}
+	block_job_t *job = (*context).blockJobs;
+	unsigned char *out = (*context).outputs;
+	(*job).out = out;
+	(*job).pairCounts = (*context).pairCounts;
+
+	int status = writeFileHeader(fpOut, (*options).checksums ? 
+		FILE_FLAG_CHECKSUMS : 0, (*options).dictionary) < 0;
+
+	symbol_code_t previousTable[256];
+	int hasTable = 0;
+	long start;
+	for(start=0; start<length && !status; start+=(*options).blockSize)
+	{
+		(*job).input = &data[start];
+		(*job).inputLength = length - start < (*options).blockSize ? 
+			length - start : (*options).blockSize;
+
+		struct timespec clock;
+		clock_gettime(CLOCK_MONOTONIC, &clock);
+		countBlock(job, options);
+		(*times).histogram += secondsSince(&clock);
+
+		clock_gettime(CLOCK_MONOTONIC, &clock);
+		status = chooseBlockCoding(job, options);
+		if(!singleTable(job))
+		{
+			(*job).reuseTable = 0;
+		}
+		else
+		{
+			chooseBlockTable(job, hasTable ? previousTable : NULL);
+		}
+		if(singleTable(job))
+		{
+			memcpy(previousTable, (*job).codeTable, sizeof(symbol_code_t)*256);
+			hasTable = 1;
+		}
+		(*times).tree += secondsSince(&clock);
+
+		clock_gettime(CLOCK_MONOTONIC, &clock);
+		encodeBlock(job);
+		if((*options).checksums)
+		{
+			appendBlockChecksum(job);
+		}
+		(*times).encode += secondsSince(&clock);
+
+		clock_gettime(CLOCK_MONOTONIC, &clock);
+		status = status || fwrite(out, sizeof(unsigned char), 
+			(*job).outLength, fpOut) != (size_t)(*job).outLength;
+		(*times).write += secondsSince(&clock);
+	}
+
+	unsigned char endBlock[BLOCK_HEADER_SIZE];
+	memset(endBlock, 0, BLOCK_HEADER_SIZE);
+	status = status || fwrite(endBlock, sizeof(unsigned char), 
+		BLOCK_HEADER_SIZE, fpOut) != BLOCK_HEADER_SIZE;
+	return status;
+}
+
+/*******************************************************************************
+ * This function fills a buffer with one kind of generated benchmark data: 
+ * text, logs, skewed, uniform, single byte or tiny text. A fixed seed gives 
+ * every run the same data.
+*******************************************************************************/
+void generateCorpus(int kind, unsigned char *data, long length)
+{
+	const char *words[16] = {"the", "of", "and", "to", "in", "a", "is", 
+		"that", "huffman", "code", "tree", "block", "with", "for", "table", 
+		"compression"};
+	const char *levels[4] = {"INFO", "INFO", "WARN", "ERROR"};
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+	long i = 0;
+	while(i < length)
+	{
+		uint64_t random = nextRandom(&state);
+		char line[128];
+		int lineLength = 0;
+		if(kind == 0 || kind == 5)
+		{
+			/*lower word indexes are more likely, as in real text.*/
+			int word = (int)((random & 15) & ((random >> 4) & 15));
+			lineLength = snprintf(line, sizeof(line), "%s%s", words[word], 
+				(random >> 8) % 12 == 0 ? ".\n" : " ");
+		}
+		else if(kind == 1)
+		{
+			lineLength = snprintf(line, sizeof(line), 
+				"2026-01-%02d %02d:%02d:%02d %s worker-%d request %08x "
+				"status=%d latency=%dms\n", (int)(1 + i/1000000 % 28), 
+				(int)(random >> 8) % 24, (int)(random >> 16) % 60, 
+				(int)(random >> 24) % 60, levels[(random >> 32) & 3], 
+				(int)(random >> 34) % 8, (unsigned int)(random >> 32), 
+				(random >> 40) % 16 == 0 ? 500 : 200, (int)(random >> 48) % 250);
+		}
+		else if(kind == 2)
+		{
+			/*about 90% of the bytes are 'e', the rest mostly text.*/
+			line[0] = (random >> 60) < 14 ? 'e' : 
+				(char)('a' + (random >> 32) % 26);
+			lineLength = 1;
+		}
+		else if(kind == 3)
+		{
+			line[0] = (char)(random >> 56);
+			lineLength = 1;
+		}
+		else
+		{
+			line[0] = 'e';
+			lineLength = 1;
+		}
+
+		if(lineLength > length - i)
+		{
+			lineLength = (int)(length - i);
+		}
+		memcpy(&data[i], line, lineLength);
+		i += lineLength;
+	}
+}
+
+/*******************************************************************************
+ * This function steps a xorshift generator and returns its new state.
+*******************************************************************************/
+uint64_t nextRandom(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+
+	return *state;
+}
+
+/*******************************************************************************
+ * This function returns the MB/s of processing length bytes rounds times.
+*******************************************************************************/
+double throughput(long length, long rounds, double seconds)
+{
+	if(seconds <= 0)
+	{
+		return 0;
+	}
+	return (double)length*rounds/1e6/seconds;
+}
+
+/*******************************************************************************
+ * This function returns the peak resident memory of the process in bytes.
+*******************************************************************************/
+long peakMemory(void)
+{
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+
+	return usage.ru_maxrss*1024L; /*kilobytes on Linux*/
+}
+
+/*******************************************************************************
+ * This function returns the seconds elapsed on the monotonic clock.
+*******************************************************************************/
+double secondsSince(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)(now.tv_sec - (*start).tv_sec) + 
+		(double)(now.tv_nsec - (*start).tv_nsec)/1e9;
+}
+
+/*******************************************************************************
+ * This function starts a stage clock.
+*******************************************************************************/
+void startTimer(struct timespec *clock)
+{
+	clock_gettime(CLOCK_MONOTONIC, clock);
+}
+
+/*******************************************************************************
+ * This function adds the seconds since the clock last ticked to a stage and 
+ * restarts the clock, so back to back stages cost one clock read each.
+*******************************************************************************/
+void lapTimer(struct timespec *clock, double *stageSeconds)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	*stageSeconds += (double)(now.tv_sec - (*clock).tv_sec) + 
+		(double)(now.tv_nsec - (*clock).tv_nsec)/1e9;
+	*clock = now;
+}
+
+/*******************************************************************************
+ * This function adds the stage times of a block to the totals of a job.
+*******************************************************************************/
+void addStageTimes(stage_times_t *total, const stage_times_t *times)
+{
+	(*total).read += (*times).read;
+	(*total).histogram += (*times).histogram;
+	(*total).tree += (*times).tree;
+	(*total).codes += (*times).codes;
+	(*total).encode += (*times).encode;
+	(*total).write += (*times).write;
+	(*total).decode += (*times).decode;
+}
+
+/*******************************************************************************
+ * This function counts a code table in the job stats, noting its symbols and
+ * its longest code.
+*******************************************************************************/
+void addTableStats(job_stats_t *stats, const symbol_code_t codeTable[256])
+{
+	(*stats).tables++;
+	int i;
+	for(i=0; i<256; i++)
+	{
+		if(codeTable[i].length == 0)
+		{
+			continue;
+		}
+		if(!(*stats).seen[i])
+		{
+			(*stats).seen[i] = 1;
+			(*stats).symbols++;
+		}
+		if(codeTable[i].length > (*stats).maxCodeLength)
+		{
+			(*stats).maxCodeLength = codeTable[i].length;
+		}
+	}
+}
+
+/*******************************************************************************
+ * This function prints the stats of a job as one JSON line on stderr.
+*******************************************************************************/
+void printStats(const char *command, const char *inputName, 
+	const job_stats_t *stats, const compress_options_t *options, int status)
+{
+	const stage_times_t *times = &(*stats).times;
+	fprintf(stderr, "{\"command\":\"%s\",\"input\":", command);
+	printJsonString(stderr, inputName);
+	fprintf(stderr, ",\"status\":\"%s\",\"bytes_in\":%" PRId64 
+		",\"bytes_out\":%" PRId64 ","
+		"\"blocks\":%ld,\"tables\":%ld,\"symbols\":%d,"
+		"\"max_code_length\":%d,\"threads\":%d,\"seconds\":%.6f,"
+		"\"stages\":{\"read\":%.6f,\"histogram\":%.6f,\"tree\":%.6f,"
+		"\"codes\":%.6f,\"encode\":%.6f,\"write\":%.6f,\"decode\":%.6f}}\n", 
+		status ? "error" : "ok", (*stats).bytesIn, (*stats).bytesOut, 
+		(*stats).blocks, (*stats).tables, (*stats).symbols, 
+		(*stats).maxCodeLength, (*options).threadCount, (*stats).seconds, 
+		(*times).read, (*times).histogram, (*times).tree, (*times).codes, 
+		(*times).encode, (*times).write, (*times).decode);
+}
+
+/*******************************************************************************
+ * This function prints text as a quoted JSON string.
+*******************************************************************************/
+void printJsonString(FILE *fp, const char *text)
+{
+	fputc('"', fp);
+	for(; *text != '\0'; text++)
+	{
+		unsigned char c = (unsigned char)*text;
+		if(c == '"' || c == '\\')
+		{
+			fprintf(fp, "\\%c", c);
+		}
+		else if(c < 0x20)
+		{
+			fprintf(fp, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, fp);
+		}
+	}
+	fputc('"', fp);
+}
+
+/*******************************************************************************
+ * This function uses huffam code to compress the input file, - for stdin, into
+ * the output file, - for stdout.
+*******************************************************************************/
+int compressFile(codec_context_t *context, const char *inputName, 
+	const char *outputName, const compress_options_t *options)
+{
+	input_source_t source;
+	if(openInputSource(&source, inputName))
+	{
+		return 1;
+	}
+	FILE *fpOut = openOutput(outputName);
+	if(fpOut == NULL)
+	{
+		closeFiles(&source, NULL, NULL, 0);
+		return 1;
+	}
+
+	/****compress the input a block at a time****/
+	job_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	struct timespec start;
+	startTimer(&start);
+	int status = (*options).adaptive ? 
+		compressAdaptive(context, &source, fpOut, options, &stats) : 
+		compressStream(context, &source, fpOut, options, &stats);
+	status = closeFiles(&source, fpOut, outputName, status);
+	stats.seconds = secondsSince(&start);
+	if(!status && (*options).verbosity > 0 && fpOut != stdout)
+	{
+		fprintf(stderr, " - written to %s\n", outputName);
+	}
+	if((*options).stats)
+	{
+		printStats("compress", inputName, &stats, options, status);
+	}
+
+	return status;
+}
+
+/*******************************************************************************
+ * This function compresses the input stream into a stream of self describing
+ * blocks. Batches of blocks pass through a pipeline of PIPELINE_DEPTH slots: 
+ * a reader thread reads the next batches while this thread codes one with the
+ * worker pool and a writer thread writes the batches before it, so reading, 
+ * coding and writing overlap. In each batch the pool builds each block's 
+ * table in parallel, the tables are chosen in block order and the pool 
+ * encodes the blocks in parallel. A block holds its own code table unless it 
+ * reuses the previous block's, and an empty block ends the stream. The output
+ * does not depend on the number of threads. Mapped input is analysed and 
+ * encoded in place, only unmapped input is read into the slot buffers. An 
+ * input which fits in one batch has a single slot and is compressed without 
+ * starting the reader and writer.
+*******************************************************************************/
+int compressStream(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats)
+{
+	int batchSize = (*options).threadCount*BLOCKS_PER_THREAD;
+	long blockSize = (*options).blockSize;
+	long outSize = maxBlockOutputSize(blockSize);
+	int depth = (*source).size >= 0 && (*source).size <= blockSize*batchSize ?
+		1 : PIPELINE_DEPTH;
+	long slotJobs = (long)batchSize*depth;
+	if(reserveBuffer(&(*context).blockJobs, &(*context).blockJobsCapacity, 
+		sizeof(block_job_t)*slotJobs) || ((*source).map == NULL && 
+		reserveBuffer(&(*context).inputs, &(*context).inputsCapacity, 
+		blockSize*slotJobs)) || reserveBuffer(&(*context).outputs, 
+		&(*context).outputsCapacity, outSize*slotJobs) || 
+		((*options).contextGroups > 1 && reserveBuffer(&(*context).pairCounts,
+		&(*context).pairCountsCapacity, sizeof(uint32_t)*256*256*batchSize)))
+	{
+		fprintf(stderr, "Cannot compress file. Memory allocation error.\n");
+		return 1;
+	}
+	if(reserveWorkerPool(context, (*options).threadCount))
+	{
+		return 1;
+	}
+
+	/****each slot has its own jobs, inputs and outputs. The pair counts are 
+	only used while a batch is analysed, so the slots share them.****/
+	compress_pipeline_t pipeline;
+	pipeline.context = context;
+	pipeline.source = source;
+	pipeline.fpOut = fpOut;
+	pipeline.options = options;
+	pipeline.stats = stats;
+	pipeline.batchSize = batchSize;
+	pipeline.failed = 0;
+	pipeline.readSeconds = 0;
+	pipeline.hasTable = 0;
+	pipeline.indexed = 1;
+	pipeline.blockCount = 0;
+	pipeline.totalIn = 0;
+	pipeline.totalOut = 0;
+	pipeline.limitCostBits = 0;
+	pipeline.tableBlock = 0;
+	int s;
+	for(s=0; s<depth; s++)
+	{
+		pipeline_slot_t *slot = &pipeline.slots[s];
+		(*slot).jobs = &(*context).blockJobs[batchSize*s];
+		(*slot).inputs = (*source).map == NULL ? 
+			&(*context).inputs[blockSize*batchSize*s] : NULL;
+		(*slot).jobCount = 0;
+		(*slot).last = 0;
+		(*slot).state = SLOT_EMPTY;
+		int j;
+		for(j=0; j<batchSize; j++)
+		{
+			(*slot).jobs[j].out = 
+				&(*context).outputs[outSize*(batchSize*s + j)];
+			(*slot).jobs[j].pairCounts = (*options).contextGroups > 1 ? 
+				&(*context).pairCounts[256*256*j] : NULL;
+		}
+	}
+
+	/****the file header is written once the first batch is read, as an 
+	input which fits in one block needs no block index.****/
+	pipeline_slot_t *first = &pipeline.slots[0];
+	int status = readBatch(&pipeline, first);
+	if(!status)
+	{
+		pipeline.indexed = (*first).jobCount > 1;
+		pipeline.totalOut = writeFileHeader(fpOut, (pipeline.indexed ? 
+			FILE_FLAG_BLOCK_INDEX : 0) | ((*options).checksums ? 
+			FILE_FLAG_CHECKSUMS : 0), (*options).dictionary);
+		status = pipeline.totalOut < 0;
+	}
+	if(!status && (*first).last)
+	{
+		status = codeBatch(&pipeline, first) || writeBatch(&pipeline, first);
+	}
+	else if(!status)
+	{
+		pthread_mutex_init(&pipeline.lock, NULL);
+		pthread_cond_init(&pipeline.changed, NULL);
+		(*first).state = SLOT_READ;
+		pthread_t reader;
+		pthread_t writer;
+		int started = 0;
+		if(pthread_create(&reader, NULL, readerMain, &pipeline) == 0)
+		{
+			started |= 1;
+		}
+		if(pthread_create(&writer, NULL, writerMain, &pipeline) == 0)
+		{
+			started |= 2;
+		}
+		if(started != 3)
+		{
+			fprintf(stderr, "Cannot start pipeline thread.\n");
+			failPipeline(&pipeline);
+		}
+
+		/****code the batches in order until the last one.****/
+		long sequence;
+		for(sequence=0; started == 3; sequence++)
+		{
+			pipeline_slot_t *slot = waitForSlot(&pipeline, sequence, 
+				SLOT_READ);
+			if(slot == NULL)
+			{
+				break;
+			}
+			int last = (*slot).last;
+			if(codeBatch(&pipeline, slot))
+			{
+				failPipeline(&pipeline);
+				break;
+			}
+			setSlotState(&pipeline, slot, SLOT_CODED);
+			if(last)
+			{
+				break;
+			}
+		}
+		if(started & 1)
+		{
+			pthread_join(reader, NULL);
+		}
+		if(started & 2)
+		{
+			pthread_join(writer, NULL);
+		}
+		status = pipeline.failed;
+		pthread_mutex_destroy(&pipeline.lock);
+		pthread_cond_destroy(&pipeline.changed);
+	}
+	(*stats).times.read += pipeline.readSeconds;
+
+	/*an empty block marks the end of the stream, the block index follows.*/
+	int64_t totalOut = pipeline.totalOut;
+	if(!status)
+	{
+		unsigned char endBlock[BLOCK_HEADER_SIZE];
+		memset(endBlock, 0, BLOCK_HEADER_SIZE);
+		if(fwrite(endBlock, sizeof(unsigned char), BLOCK_HEADER_SIZE, fpOut) != 
+			BLOCK_HEADER_SIZE)
+		{
+			fprintf(stderr, "output file cannot be written.\n");
+			status = 1;
+		}
+		totalOut += BLOCK_HEADER_SIZE;
+	}
+	if(!status && pipeline.indexed)
+	{
+		if(writeBlockIndex(fpOut, (*context).entries, pipeline.blockCount, 
+			(uint64_t)totalOut))
+		{
+			status = 1;
+		}
+		totalOut += pipeline.blockCount*INDEX_ENTRY_SIZE + INDEX_FOOTER_SIZE;
+	}
+	(*stats).bytesIn = pipeline.totalIn;
+	(*stats).bytesOut = totalOut;
+	(*stats).blocks = pipeline.blockCount;
+	if(!status && (*options).verbosity > 0)
+	{
+		fprintf(stderr, " - %" PRId64 " bytes in %ld blocks compressed to %" 
+			PRId64 " bytes\n", pipeline.totalIn, pipeline.blockCount, 
+			totalOut);
+		if(pipeline.limitCostBits > 0)
+		{
+			fprintf(stderr, " - %d bit code length limit cost %" PRId64 
+				" bytes (%.3f%%)\n", 
+				(*options).maxCodeLength, pipeline.limitCostBits/8, 
+				100.0*pipeline.limitCostBits/8/totalOut);
+		}
+	}
+
+	return status;
+}
+
+/*******************************************************************************
+ * This function reads the next batch of blocks into the slot and marks it 
+ * last when the input ends. The pages of mapped input are read once here, so 
+ * they are faulted in on the reader thread rather than by the coding threads.
+*******************************************************************************/
+int readBatch(compress_pipeline_t *pipeline, pipeline_slot_t *slot)
+{
+	long blockSize = (*(*pipeline).options).blockSize;
+	block_job_t *jobs = (*slot).jobs;
+	struct timespec clock;
+	if((*(*pipeline).options).stats)
+	{
+		startTimer(&clock);
+	}
+
+	int jobCount = 0;
+	long blockLength = 0;
+	while(jobCount < (*pipeline).batchSize)
+	{
+		blockLength = readInput((*pipeline).source, (*slot).inputs == NULL ? 
+			NULL : &(*slot).inputs[blockSize*jobCount], blockSize, 
+			&jobs[jobCount].input);
+		if(blockLength <= 0)
+		{
+			break;
+		}
+		jobs[jobCount].inputLength = blockLength;
+		if((*slot).inputs == NULL)
+		{
+			const volatile unsigned char *page = jobs[jobCount].input;
+			long i;
+			for(i=0; i<blockLength; i+=PAGE_TOUCH_STRIDE)
+			{
+				(void)page[i];
+			}
+		}
+		jobCount++;
+	}
+	if(blockLength < 0)
+	{
+		return 1;
+	}
+	(*slot).jobCount = jobCount;
+	(*slot).last = blockLength == 0 || ((*(*pipeline).source).size >= 0 && 
+		(*(*pipeline).source).position >= (*(*pipeline).source).size);
+
+	if((*(*pipeline).options).stats)
+	{
+		lapTimer(&clock, &(*pipeline).readSeconds);
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This function codes the blocks of a slot. The pool builds the tables, they 
+ * are chosen in block order, then the pool encodes the blocks. Blocks coded 
+ * with the trained table, with order-1 tables or not coded at all leave the 
+ * previous stored table in place.
+*******************************************************************************/
+int codeBatch(compress_pipeline_t *pipeline, pipeline_slot_t *slot)
+{
+	const compress_options_t *options = (*pipeline).options;
+	worker_pool_t *pool = &(*(*pipeline).context).pool;
+	block_job_t *jobs = (*slot).jobs;
+	int jobCount = (*slot).jobCount;
+	if(jobCount == 0)
+	{
+		return 0;
+	}
+	compress_batch_t batch;
+	batch.jobs = jobs;
+	batch.options = options;
+
+	runWorkerPool(pool, analyseBlockTask, &batch, jobCount);
+	int j;
+	for(j=0; j<jobCount; j++)
+	{
+		if(jobs[j].status)
+		{
+			return 1;
+		}
+		if(jobs[j].dictionary)
+		{
+			jobs[j].reuseTable = 0;
+			memcpy(jobs[j].codeTable, (*(*options).dictionary).codeTable, 
+				sizeof(symbol_code_t)*256);
+			continue;
+		}
+		if(!singleTable(&jobs[j]))
+		{
+			jobs[j].reuseTable = 0;
+			continue;
+		}
+		chooseBlockTable(&jobs[j], (*pipeline).hasTable ? 
+			(*pipeline).codeTable : NULL);
+		if(singleTable(&jobs[j]))
+		{
+			memcpy((*pipeline).codeTable, jobs[j].codeTable, 
+				sizeof(symbol_code_t)*256);
+			(*pipeline).hasTable = 1;
+		}
+	}
+	runWorkerPool(pool, encodeBlockTask, &batch, jobCount);
+	return 0;
+}
+
+/*******************************************************************************
+ * This function writes the coded blocks of a slot in block order, indexing 
+ * each block and adding its tables and stage times to the stats.
+*******************************************************************************/
+int writeBatch(compress_pipeline_t *pipeline, pipeline_slot_t *slot)
+{
+	codec_context_t *context = (*pipeline).context;
+	const compress_options_t *options = (*pipeline).options;
+	job_stats_t *stats = (*pipeline).stats;
+	block_job_t *jobs = (*slot).jobs;
+	int jobCount = (*slot).jobCount;
+	struct timespec clock;
+	if((*options).stats)
+	{
+		startTimer(&clock);
+	}
+
+	long blockCount = (*pipeline).blockCount;
+	long entriesSize = sizeof(index_entry_t)*(blockCount + jobCount);
+	if(entriesSize > (*context).entriesCapacity && 
+		reserveBuffer(&(*context).entries, &(*context).entriesCapacity, 
+		2*entriesSize))
+	{
+		fprintf(stderr, "Cannot compress file. Memory allocation error.\n");
+		return 1;
+	}
+	index_entry_t *entries = (*context).entries;
+	int j;
+	for(j=0; j<jobCount; j++)
+	{
+		int ownTable = singleTable(&jobs[j]) && !jobs[j].reuseTable;
+		if(ownTable)
+		{
+			(*pipeline).tableBlock = blockCount;
+		}
+		entries[blockCount].offset = (uint64_t)(*pipeline).totalOut;
+		entries[blockCount].payloadBits = (uint32_t)jobs[j].payloadBits;
+		entries[blockCount].blockLength = (uint32_t)jobs[j].inputLength;
+		entries[blockCount].tableBlock = (uint32_t)(singleTable(&jobs[j]) ? 
+			(*pipeline).tableBlock : blockCount);
+
+		int g;
+		for(g=0; g<jobs[j].order1.groupCount; g++)
+		{
+			addTableStats(stats, jobs[j].order1.codeTables[g]);
+			if((*options).verbosity > 1)
+			{
+				fprintf(stderr, "block %ld group %d huffman codes:\n", 
+					blockCount, g);
+				printHuffmanCodes(jobs[j].order1.codeTables[g]);
+			}
+		}
+		if(ownTable)
+		{
+			addTableStats(stats, jobs[j].codeTable);
+			if((*options).verbosity > 1)
+			{
+				fprintf(stderr, "block %ld huffman codes:\n", blockCount);
+				printHuffmanCodes(jobs[j].codeTable);
+			}
+		}
+		addStageTimes(&(*stats).times, &jobs[j].times);
+		if(fwrite(jobs[j].out, sizeof(unsigned char), jobs[j].outLength, 
+			(*pipeline).fpOut) != (size_t)jobs[j].outLength)
+		{
+			fprintf(stderr, "output file cannot be written.\n");
+			return 1;
+		}
+		blockCount++;
+		(*pipeline).blockCount = blockCount;
+		(*pipeline).totalIn += jobs[j].inputLength;
+		(*pipeline).totalOut += jobs[j].outLength;
+		if(!jobs[j].reuseTable)
+		{
+			(*pipeline).limitCostBits += jobs[j].limitCostBits;
+		}
+	}
+
+	if((*options).stats)
+	{
+		lapTimer(&clock, &(*stats).times.write);
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This function is the reader thread of the pipeline. The first batch is 
+ * read before the thread starts, so it reads from the second batch on into 
+ * each slot the writer has emptied, until the input ends.
+*******************************************************************************/
+void *readerMain(void *argument)
+{
+	compress_pipeline_t *pipeline = argument;
+	long sequence;
+	for(sequence=1; ; sequence++)
+	{
+		pipeline_slot_t *slot = waitForSlot(pipeline, sequence, SLOT_EMPTY);
+		if(slot == NULL)
+		{
+			break;
+		}
+		if(readBatch(pipeline, slot))
+		{
+			failPipeline(pipeline);
+			break;
+		}
+		int last = (*slot).last;
+		setSlotState(pipeline, slot, SLOT_READ);
+		if(last)
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This function is the writer thread of the pipeline. It writes each coded 
+ * slot in order and hands it back to the reader, until the last batch.
+*******************************************************************************/
+void *writerMain(void *argument)
+{
+	compress_pipeline_t *pipeline = argument;
+	long sequence;
+	for(sequence=0; ; sequence++)
+	{
+		pipeline_slot_t *slot = waitForSlot(pipeline, sequence, SLOT_CODED);
+		if(slot == NULL)
+		{
+			break;
+		}
+		if(writeBatch(pipeline, slot))
+		{
+			failPipeline(pipeline);
+			break;
+		}
+		if((*slot).last)
+		{
+			break;
+		}
+		setSlotState(pipeline, slot, SLOT_EMPTY);
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This function waits until the slot of the given batch reaches the state. 
+ * Once a thread passes a slot on, the next thread may refill it, so a thread 
+ * reads what it needs from the slot first. Returns the slot, or NULL once the
+ * pipeline has failed.
+*******************************************************************************/
+pipeline_slot_t *waitForSlot(compress_pipeline_t *pipeline, long sequence, 
+	int state)
+{
+	pipeline_slot_t *slot = &(*pipeline).slots[sequence % PIPELINE_DEPTH];
+	pthread_mutex_lock(&(*pipeline).lock);
+	while((*slot).state != state && !(*pipeline).failed)
+	{
+		pthread_cond_wait(&(*pipeline).changed, &(*pipeline).lock);
+	}
+	if((*pipeline).failed)
+	{
+		slot = NULL;
+	}
+	pthread_mutex_unlock(&(*pipeline).lock);
+	return slot;
+}
+
+/*******************************************************************************
+ * This function moves a slot to the next stage and wakes the other threads.
+*******************************************************************************/
+void setSlotState(compress_pipeline_t *pipeline, pipeline_slot_t *slot, 
+	int state)
+{
+	pthread_mutex_lock(&(*pipeline).lock);
+	(*slot).state = state;
+	pthread_cond_broadcast(&(*pipeline).changed);
+	pthread_mutex_unlock(&(*pipeline).lock);
+}
+
+/*******************************************************************************
+ * This function stops every thread of the pipeline after an error.
+*******************************************************************************/
+void failPipeline(compress_pipeline_t *pipeline)
+{
+	pthread_mutex_lock(&(*pipeline).lock);
+	(*pipeline).failed = 1;
+	pthread_cond_broadcast(&(*pipeline).changed);
+	pthread_mutex_unlock(&(*pipeline).lock);
+}
+
+/*******************************************************************************
+ * This function compresses the input stream in one pass with adaptive codes. 
+ * Each block is coded as soon as it is read, from whatever a pipe has ready, 
+ * and is flushed straight away, so a live stream is never held back. Blocks 
+ * carry no tables and depend on the blocks before them, so the file has no 
+ * block index.
+*******************************************************************************/
+int compressAdaptive(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats)
+{
+	long blockSize = (*options).blockSize < ADAPTIVE_BLOCK_SIZE ? 
+		(*options).blockSize : ADAPTIVE_BLOCK_SIZE;
+	long outSize = BLOCK_HEADER_SIZE + blockSize*ADAPTIVE_CODE_LENGTH/8 + 16 + 
+		CHECKSUM_SIZE;
+	if(((*source).map == NULL && reserveBuffer(&(*context).inputs, 
+		&(*context).inputsCapacity, blockSize)) || 
+		reserveBuffer(&(*context).outputs, &(*context).outputsCapacity, 
+		outSize))
+	{
+		fprintf(stderr, "Cannot compress file. Memory allocation error.\n");
+		return 1;
+	}
+	adaptive_model_t model;
+	if(initAdaptiveModel(&model, NULL))
+	{
+		return 1;
+	}
+
+	int64_t totalOut = writeFileHeader(fpOut, (*options).checksums ? 
+		FILE_FLAG_CHECKSUMS : 0, NULL);
+	int status = totalOut < 0;
+	int64_t totalIn = 0;
+	long blockCount = 0;
+	struct timespec clock;
+	if((*options).stats)
+	{
+		startTimer(&clock);
+	}
+	while(!status)
+	{
+		const unsigned char *input;
+		long blockLength = readAvailable(source, (*context).inputs, blockSize, 
+			&input);
+		if(blockLength <= 0)
+		{
+			status = blockLength < 0;
+			break;
+		}
+		if((*options).stats)
+		{
+			lapTimer(&clock, &(*stats).times.read);
+		}
+		long outLength = encodeAdaptive(&model, input, blockLength, 
+			(*context).outputs);
+		if(outLength < 0)
+		{
+			status = 1;
+			break;
+		}
+		if((*options).checksums)
+		{
+			storeU32(&(*context).outputs[outLength], 
+				crc32c(0, input, blockLength));
+			outLength += CHECKSUM_SIZE;
+		}
+		if((*options).stats)
+		{
+			lapTimer(&clock, &(*stats).times.encode);
+		}
+		if(fwrite((*context).outputs, sizeof(unsigned char), outLength, 
+			fpOut) != (size_t)outLength || fflush(fpOut) != 0)
+		{
+			fprintf(stderr, "output file cannot be written.\n");
+			status = 1;
+			break;
+		}
+		if((*options).stats)
+		{
+			lapTimer(&clock, &(*stats).times.write);
+		}
+		totalIn += blockLength;
+		totalOut += outLength;
+		blockCount++;
+	}
+
+	/*an empty block marks the end of the stream.*/
+	if(!status)
+	{
+		unsigned char endBlock[BLOCK_HEADER_SIZE];
+		memset(endBlock, 0, BLOCK_HEADER_SIZE);
+		if(fwrite(endBlock, sizeof(unsigned char), BLOCK_HEADER_SIZE, fpOut) != 
+			BLOCK_HEADER_SIZE)
+		{
+			fprintf(stderr, "output file cannot be written.\n");
+			status = 1;
+		}
+		totalOut += BLOCK_HEADER_SIZE;
+	}
+	(*stats).bytesIn = totalIn;
+	(*stats).bytesOut = totalOut;
+	(*stats).blocks = blockCount;
+	if(!status && (*options).verbosity > 0)
+	{
+		fprintf(stderr, " - %" PRId64 " bytes in %ld adaptive blocks "
+			"compressed to %" PRId64 " bytes\n", totalIn, blockCount, totalOut);
+	}
+
+	return status;
+}
+
+/*******************************************************************************
+ * This function writes the file header, followed by the ID of the trained 
+ * table when there is one and the header's checksum when the flags ask for 
+ * one. Returns the length written, or -1.
+*******************************************************************************/
+long writeFileHeader(FILE *fpOut, int flags, const dictionary_t *dictionary)
+{
+	unsigned char fileHeader[FILE_HEADER_SIZE + DICTIONARY_ID_SIZE + 
+		CHECKSUM_SIZE];
+	long length = FILE_HEADER_SIZE;
+	memcpy(fileHeader, FILE_MAGIC, FILE_MAGIC_SIZE);
+	fileHeader[FILE_MAGIC_SIZE] = FORMAT_VERSION;
+	if(dictionary != NULL)
+	{
+		flags |= FILE_FLAG_DICTIONARY;
+		storeU32(&fileHeader[FILE_HEADER_SIZE], (*dictionary).id);
+		length += DICTIONARY_ID_SIZE;
+	}
+	fileHeader[FILE_MAGIC_SIZE + 1] = (unsigned char)flags;
+	if(flags & FILE_FLAG_CHECKSUMS)
+	{
+		storeU32(&fileHeader[length], crc32c(0, fileHeader, length));
+		length += CHECKSUM_SIZE;
+	}
+	if(fwrite(fileHeader, sizeof(unsigned char), length, fpOut) != 
+		(size_t)length)
+	{
+		fprintf(stderr, "output file cannot be written.\n");
+		return -1;
+	}
+
+	return length;
+}
+
+/*******************************************************************************
+ * This function trains a table on sample inputs and writes it as a table file
+ * for -d. Every byte value gets a code, so any input can be coded with it, 
+ * and the samples' counts are scaled down to fit the tree builder.
+*******************************************************************************/
+int trainDictionary(char **inputNames, int inputCount, const char *outputName,
+	const compress_options_t *options)
+{
+	uint64_t totals[256];
+	uint64_t freq[256];
+	memset(totals, 0, sizeof(totals));
+	unsigned char *buffer = malloc(sizeof(unsigned char)*BLOCK_SIZE);
+	if(buffer == NULL)
+	{
+		fprintf(stderr, "Cannot train table. Memory allocation error.\n");
+		return 1;
+	}
+
+	/****count the bytes of every sample.****/
+	int64_t sampleBytes = 0;
+	int status = 0;
+	int i;
+	for(i=0; i<inputCount && !status; i++)
+	{
+		input_source_t source;
+		if(openInputSource(&source, inputNames[i]))
+		{
+			status = 1;
+			break;
+		}
+		const unsigned char *data;
+		long length;
+		while((length = readInput(&source, buffer, BLOCK_SIZE, &data)) > 0)
+		{
+			byteHistogram(data, length, freq);
+			int c;
+			for(c=0; c<256; c++)
+			{
+				totals[c] += freq[c];
+			}
+			sampleBytes += length;
+		}
+		status = length < 0;
+		closeInputSource(&source);
+	}
+	free(buffer);
+	if(status)
+	{
+		return 1;
+	}
+
+	/****scale the counts and build the codes.****/
+	uint64_t maxCount = 0;
+	for(i=0; i<256; i++)
+	{
+		if(totals[i] > maxCount)
+		{
+			maxCount = totals[i];
+		}
+	}
+	int shift = 0;
+	while((maxCount >> shift) >= MAX_TRAINING_COUNT)
+	{
+		shift++;
+	}
+	unsigned char symbols[256];
+	int charFreq[256];
+	for(i=0; i<256; i++)
+	{
+		symbols[i] = (unsigned char)i;
+		charFreq[i] = (int)(totals[i] >> shift) + 1;
+	}
+	symbol_code_t codeTable[256];
+	long limitCostBits;
+	if(generateHuffmanCodes(symbols, charFreq, 256, codeTable, 
+		(*options).maxCodeLength, &limitCostBits, NULL))
+	{
+		return 1;
+	}
+
+	/****the table file holds the stored table and its ID.****/
+	unsigned char table[DICTIONARY_HEADER_SIZE + MAX_BLOCK_TABLE_SIZE];
+	long tableLength = writeBlockTable(codeTable, 
+		&table[DICTIONARY_HEADER_SIZE]);
+	uint32_t id = tableId(&table[DICTIONARY_HEADER_SIZE], tableLength);
+	memcpy(table, DICTIONARY_MAGIC, FILE_MAGIC_SIZE);
+	table[FILE_MAGIC_SIZE] = FORMAT_VERSION;
+	storeU32(&table[FILE_MAGIC_SIZE + 1], id);
+	FILE *fpOut = openOutput(outputName);
+	if(fpOut == NULL)
+	{
+		return 1;
+	}
+	long length = DICTIONARY_HEADER_SIZE + tableLength;
+	if(fwrite(table, sizeof(unsigned char), length, fpOut) != (size_t)length)
+	{
+		fprintf(stderr, "output file cannot be written.\n");
+		status = 1;
+	}
+	status = closeFiles(NULL, fpOut, outputName, status);
+	if(!status && (*options).verbosity > 0)
+	{
+		fprintf(stderr, " - trained on %" PRId64 " bytes, table %08x written "
+			"to %s\n", sampleBytes, (unsigned int)id, outputName);
+		if((*options).verbosity > 1)
+		{
+			printHuffmanCodes(codeTable);
+		}
+	}
+
+	return status;
+}
+
+/*******************************************************************************
+ * This function reads a table file made by train and builds its codes and 
+ * decode tables.
+*******************************************************************************/
+int loadDictionary(const char *name, dictionary_t *dictionary)
+{
+	input_source_t source;
+	if(openInputSource(&source, name))
+	{
+		return 1;
+	}
+	unsigned char buffer[DICTIONARY_HEADER_SIZE + MAX_BLOCK_TABLE_SIZE];
+	const unsigned char *data;
+	long length = readInput(&source, buffer, sizeof(buffer), &data);
+	int status = length < DICTIONARY_HEADER_SIZE + 1 || 
+		memcmp(data, DICTIONARY_MAGIC, FILE_MAGIC_SIZE) != 0 || 
+		data[FILE_MAGIC_SIZE] != FORMAT_VERSION;
+	if(!status)
+	{
+		(*dictionary).id = loadU32(&data[FILE_MAGIC_SIZE + 1]);
+		long tableLength = parseBlockTable(&data[DICTIONARY_HEADER_SIZE], 
+			length - DICTIONARY_HEADER_SIZE, &(*dictionary).decodeTable, 
+			(*dictionary).codeTable);
+		status = tableLength < 0 || tableId(&data[DICTIONARY_HEADER_SIZE], 
+			tableLength) != (*dictionary).id;
+	}
+	closeInputSource(&source);
+	if(status)
+	{
+		fprintf(stderr, "%s is not a trained table.\n", name);
+	}
+
+	return status;
+}
+
+/*******************************************************************************
+ * This function returns the ID of a stored table, its 32 bit FNV-1a hash.
+*******************************************************************************/
+uint32_t tableId(const unsigned char *table, long length)
+{
+	uint32_t hash = 2166136261u;
+	long i;
+	for(i=0; i<length; i++)
+	{
+		hash = (hash ^ table[i])*16777619u;
+	}
+	return hash;
+}
+
+/*******************************************************************************
+ * This function compresses the named files and directories, - for a list of 
+ * names on stdin, into one archive. Each member is a complete compressed file,
+ * and a directory of names, offsets and lengths at the end locates them, so 
+ * any member is extracted without reading the others. Members which fit in 
+ * one batch are compressed in parallel, one per pool task, and larger members 
+ * one at a time across the whole pool.
+*******************************************************************************/
+int createArchive(codec_context_t *context, char **inputNames, int inputCount,
+	const char *outputName, const compress_options_t *options)
+{
+	archive_list_t list;
+	memset(&list, 0, sizeof(list));
+	int status = 0;
+	int i;
+	for(i=0; i<inputCount && !status; i++)
+	{
+		status = addArchiveInput(&list, inputNames[i]);
+	}
+	if(status)
+	{
+		freeArchiveList(&list);
+		return 1;
+	}
+
+	/****small members are coded on one thread each, with their own context, 
+	and quietly as the archive reports the totals.****/
+	int threadCount = (*options).threadCount;
+	compress_options_t memberOptions = *options;
+	memberOptions.threadCount = 1;
+	memberOptions.verbosity = 0;
+	compress_options_t largeOptions = *options;
+	largeOptions.verbosity = 0;
+	archive_batch_t batch;
+	memset(&batch, 0, sizeof(batch));
+	batch.list = &list;
+	batch.pool = &(*context).pool;
+	batch.jobs = malloc(sizeof(archive_job_t)*threadCount);
+	batch.contexts = malloc(sizeof(codec_context_t)*threadCount);
+	batch.options = &memberOptions;
+	if(batch.jobs == NULL || batch.contexts == NULL)
+	{
+		fprintf(stderr, "Cannot create archive. Memory allocation error.\n");
+		free(batch.jobs);
+		free(batch.contexts);
+		freeArchiveList(&list);
+		return 1;
+	}
+	for(i=0; i<threadCount; i++)
+	{
+		initContext(&batch.contexts[i]);
+		batch.jobs[i].data = NULL;
+	}
+	struct timespec start;
+	startTimer(&start);
+	FILE *fpOut = openOutput(outputName);
+	status = fpOut == NULL || reserveWorkerPool(context, threadCount);
+
+	/****the archive header, then the members in order.****/
+	if(!status)
+	{
+		unsigned char header[FILE_HEADER_SIZE];
+		memcpy(header, ARCHIVE_MAGIC, FILE_MAGIC_SIZE);
+		header[FILE_MAGIC_SIZE] = FORMAT_VERSION;
+		header[FILE_MAGIC_SIZE + 1] = 0;
+		if(fwrite(header, sizeof(unsigned char), FILE_HEADER_SIZE, fpOut) != 
+			FILE_HEADER_SIZE)
+		{
+			fprintf(stderr, "output file cannot be written.\n");
+			status = 1;
+		}
+		batch.fpOut = fpOut;
+		batch.offset = FILE_HEADER_SIZE;
+	}
+	long smallLength = (*options).blockSize*BLOCKS_PER_THREAD;
+	int jobCount = 0;
+	long m;
+	for(m=0; m<list.count && !status; m++)
+	{
+		archive_member_t *member = &list.members[m];
+		if((*member).inputSize >= 0 && (*member).inputSize <= smallLength)
+		{
+			batch.jobs[jobCount++].member = m;
+			if(jobCount == threadCount)
+			{
+				status = compressArchiveBatch(&batch, jobCount);
+				jobCount = 0;
+			}
+			continue;
+		}
+		status = compressArchiveBatch(&batch, jobCount);
+		jobCount = 0;
+		if(status)
+		{
+			break;
+		}
+		job_stats_t stats;
+		memset(&stats, 0, sizeof(stats));
+		status = compressMember(context, (*member).path, fpOut, &largeOptions,
+			&stats);
+		(*member).offset = batch.offset;
+		(*member).compressedLength = (uint64_t)stats.bytesOut;
+		(*member).length = (uint64_t)stats.bytesIn;
+		batch.offset += (uint64_t)stats.bytesOut;
+		addJobStats(&batch.stats, &stats);
+	}
+	if(!status)
+	{
+		status = compressArchiveBatch(&batch, jobCount);
+	}
+	long directoryLength = -1;
+	if(!status)
+	{
+		directoryLength = writeArchiveDirectory(fpOut, &list, batch.offset);
+		status = directoryLength < 0;
+	}
+	status = closeFiles(NULL, fpOut, outputName, status);
+	batch.stats.seconds = secondsSince(&start);
+	batch.stats.bytesOut = (int64_t)batch.offset + directoryLength;
+	if(!status && (*options).verbosity > 0)
+	{
+		fprintf(stderr, " - %ld files of %" PRId64 " bytes archived to %" 
+			PRId64 " bytes\n", list.count, batch.stats.bytesIn, 
+			batch.stats.bytesOut);
+		if(fpOut != stdout)
+		{
+			fprintf(stderr, " - written to %s\n", outputName);
+		}
+	}
+	if((*options).stats)
+	{
+		printStats("archive", outputName, &batch.stats, options, status);
+	}
+
+	for(i=0; i<threadCount; i++)
+	{
+		destroyContext(&batch.contexts[i]);
+	}
+	free(batch.jobs);
+	free(batch.contexts);
+	freeArchiveList(&list);
+	return status;
+}
+
+/*******************************************************************************
+ * This function compresses a batch of small members in parallel, then writes 
+ * them to the archive in order.
+*******************************************************************************/
+int compressArchiveBatch(archive_batch_t *batch, int jobCount)
+{
+	if(jobCount == 0)
+	{
+		return 0;
+	}
+	runWorkerPool((*batch).pool, compressMemberTask, batch, jobCount);
+
+	int status = 0;
+	int j;
+	for(j=0; j<jobCount; j++)
+	{
+		archive_job_t *job = &(*batch).jobs[j];
+		archive_member_t *member = &(*(*batch).list).members[(*job).member];
+		status |= (*job).status;
+		if(!status && fwrite((*job).data, sizeof(unsigned char), 
+			(*job).dataLength, (*batch).fpOut) != (*job).dataLength)
+		{
+			fprintf(stderr, "output file cannot be written.\n");
+			status = 1;
+		}
+		if(!status)
+		{
+			(*member).offset = (*batch).offset;
+			(*member).compressedLength = (uint64_t)(*job).dataLength;
+			(*member).length = (uint64_t)(*job).stats.bytesIn;
+			(*batch).offset += (uint64_t)(*job).dataLength;
+			addJobStats(&(*batch).stats, &(*job).stats);
+		}
+		free((*job).data);
+		(*job).data = NULL;
+	}
+	return status;
+}
+
+/*******************************************************************************
+ * This function is the pool task compressing a small member into memory with 
+ * the task's own context.
+*******************************************************************************/
+void compressMemberTask(void *context, int index)
+{
+	archive_batch_t *batch = context;
+	archive_job_t *job = &(*batch).jobs[index];
+	const archive_member_t *member = &(*(*batch).list).members[(*job).member];
+
+	memset(&(*job).stats, 0, sizeof(job_stats_t));
+	(*job).data = NULL;
+	(*job).dataLength = 0;
+	FILE *fpOut = open_memstream(&(*job).data, &(*job).dataLength);
+	if(fpOut == NULL)
+	{
+		fprintf(stderr, "Cannot compress %s. Memory allocation error.\n", 
+			(*member).path);
+		(*job).status = 1;
+		return;
+	}
+	(*job).status = compressMember(&(*batch).contexts[index], (*member).path, 
+		fpOut, (*batch).options, &(*job).stats);
+	if(fclose(fpOut) != 0)
+	{
+		(*job).status = 1;
+	}
+}
+
+/*******************************************************************************
+ * This function compresses one input file into an output stream, such as an 
+ * archive, which is left open.
+*******************************************************************************/
+int compressMember(codec_context_t *context, const char *inputName, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats)
+{
+	input_source_t source;
+	if(openInputSource(&source, inputName))
+	{
+		return 1;
+	}
+	int status = (*options).adaptive ? 
+		compressAdaptive(context, &source, fpOut, options, stats) : 
+		compressStream(context, &source, fpOut, options, stats);
+	closeInputSource(&source);
+	return status;
+}
+
+/*******************************************************************************
+ * This function adds an input named on the command line to the archive list.
+ * - reads the names from stdin instead, one per line.
+*******************************************************************************/
+int addArchiveInput(archive_list_t *list, const char *name)
+{
+	if(strcmp(name, "-") != 0)
+	{
+		return addArchivePath(list, name, 1);
+	}
+
+	char *line = NULL;
+	size_t lineCapacity = 0;
+	ssize_t length;
+	int status = 0;
+	while(!status && (length = getline(&line, &lineCapacity, stdin)) > 0)
+	{
+		while(length > 0 && (line[length - 1] == '\n' || 
+			line[length - 1] == '\r'))
+		{
+			line[--length] = '\0';
+		}
+		if(length > 0)
+		{
+			status = addArchivePath(list, line, 1);
+		}
+	}
+	if(!status && ferror(stdin))
+	{
+		fprintf(stderr, "Cannot read input file.\n");
+		status = 1;
+	}
+	free(line);
+	return status;
+}
+
+/*******************************************************************************
+ * This function adds a file, or the files under a directory, to the archive 
+ * list. Named inputs may be links or special files such as pipes, but inside 
+ * directories only regular files and directories are followed.
+*******************************************************************************/
+int addArchivePath(archive_list_t *list, const char *name, int top)
+{
+	struct stat info;
+	if((top ? stat(name, &info) : lstat(name, &info)) != 0)
+	{
+		fprintf(stderr, "Cannot open %s. File not found.\n", name);
+		return 1;
+	}
+	if(S_ISDIR(info.st_mode))
+	{
+		return addArchiveDirectory(list, name);
+	}
+	if(S_ISREG(info.st_mode))
+	{
+		return addArchiveMember(list, name, (int64_t)info.st_size);
+	}
+	return top ? addArchiveMember(list, name, -1) : 0;
+}
+
+/*******************************************************************************
+ * This function adds the files under a directory in name order, so the same 
+ * tree always gives the same archive.
+*******************************************************************************/
+int addArchiveDirectory(archive_list_t *list, const char *name)
+{
+	DIR *directory = opendir(name);
+	if(directory == NULL)
+	{
+		fprintf(stderr, "Cannot open directory %s.\n", name);
+		return 1;
+	}
+	size_t nameLength = strlen(name);
+	const char *separator = nameLength > 0 && name[nameLength - 1] == '/' ? 
+		"" : "/";
+	char **children = NULL;
+	long childrenCapacity = 0;
+	long childCount = 0;
+	int status = 0;
+	struct dirent *entry;
+	while((entry = readdir(directory)) != NULL)
+	{
+		if(strcmp((*entry).d_name, ".") == 0 || 
+			strcmp((*entry).d_name, "..") == 0)
+		{
+			continue;
+		}
+		long size = sizeof(char *)*(childCount + 1);
+		size_t childLength = nameLength + strlen(separator) + 
+			strlen((*entry).d_name) + 1;
+		char *child = NULL;
+		if((size > childrenCapacity && reserveBuffer(&children, 
+			&childrenCapacity, 2*size)) || 
+			(child = malloc(childLength)) == NULL)
+		{
+			fprintf(stderr, "Cannot read directory %s. Memory allocation "
+				"error.\n", name);
+			status = 1;
+			break;
+		}
+		snprintf(child, childLength, "%s%s%s", name, separator, 
+			(*entry).d_name);
+		children[childCount++] = child;
+	}
+	closedir(directory);
+
+	if(childCount > 0)
+	{
+		qsort(children, childCount, sizeof(char *), compareNames);
+	}
+	long i;
+	for(i=0; i<childCount; i++)
+	{
+		if(!status)
+		{
+			status = addArchivePath(list, children[i], 0);
+		}
+		free(children[i]);
+	}
+	free(children);
+	return status;
+}
+
+/*******************************************************************************
+ * This function appends a file to the archive list. The stored name is the 
+ * path without any leading /, ./ or ../, and must not climb out with .. when 
+ * it is extracted.
+*******************************************************************************/
+int addArchiveMember(archive_list_t *list, const char *path, 
+	int64_t inputSize)
+{
+	const char *name = path;
+	while(1)
+	{
+		if(name[0] == '/')
+		{
+			name++;
+		}
+		else if(strncmp(name, "./", 2) == 0)
+		{
+			name += 2;
+		}
+		else if(strncmp(name, "../", 3) == 0)
+		{
+			name += 3;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if(strlen(name) > MAX_MEMBER_NAME || !memberNameSafe(name))
+	{
+		fprintf(stderr, "Cannot archive %s, the name cannot be stored.\n", 
+			path);
+		return 1;
+	}
+
+	long size = sizeof(archive_member_t)*((*list).count + 1);
+	char *copy = NULL;
+	if((size > (*list).capacity && reserveBuffer(&(*list).members, 
+		&(*list).capacity, 2*size)) || (copy = strdup(path)) == NULL)
+	{
+		fprintf(stderr, "Cannot create archive. Memory allocation error.\n");
+		return 1;
+	}
+	archive_member_t *member = &(*list).members[(*list).count];
+	(*member).path = copy;
+	(*member).name = &copy[name - path];
+	(*member).inputSize = inputSize;
+	(*member).offset = 0;
+	(*member).compressedLength = 0;
+	(*member).length = 0;
+	(*list).count++;
+	return 0;
+}
+
+/*******************************************************************************
+ * This function orders names for qsort.
+*******************************************************************************/
+int compareNames(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*******************************************************************************
+ * This function writes the archive directory, an entry and the name of each 
+ * member, and the footer locating it. Returns the length written, or -1.
+*******************************************************************************/
+long writeArchiveDirectory(FILE *fpOut, const archive_list_t *list, 
+	uint64_t directoryOffset)
+{
+	/*the footer holds a 32 bit member count.*/
+	if((uint64_t)(*list).count > UINT32_MAX)
+	{
+		fprintf(stderr, "Too many files to archive.\n");
+		return -1;
+	}
+	unsigned char entry[ARCHIVE_ENTRY_SIZE];
+	long length = 0;
+	long i;
+	for(i=0; i<(*list).count; i++)
+	{
+		const archive_member_t *member = &(*list).members[i];
+		size_t nameLength = strlen((*member).name);
+		storeU64(entry, (*member).offset);
+		storeU64(&entry[8], (*member).compressedLength);
+		storeU64(&entry[16], (*member).length);
+		storeU32(&entry[24], (uint32_t)nameLength);
+		if(fwrite(entry, sizeof(unsigned char), ARCHIVE_ENTRY_SIZE, fpOut) != 
+			ARCHIVE_ENTRY_SIZE || fwrite((*member).name, sizeof(char), 
+			nameLength, fpOut) != nameLength)
+		{
+			fprintf(stderr, "output file cannot be written.\n");
+			return -1;
+		}
+		length += ARCHIVE_ENTRY_SIZE + (long)nameLength;
+	}
+
+	unsigned char footer[ARCHIVE_FOOTER_SIZE];
+	storeU64(footer, directoryOffset);
+	storeU32(&footer[8], (uint32_t)(*list).count);
+	memcpy(&footer[12], ARCHIVE_DIRECTORY_MAGIC, FILE_MAGIC_SIZE);
+	if(fwrite(footer, sizeof(unsigned char), ARCHIVE_FOOTER_SIZE, fpOut) != 
+		ARCHIVE_FOOTER_SIZE)
+	{
+		fprintf(stderr, "output file cannot be written.\n");
+		return -1;
+	}
+
+	return length + ARCHIVE_FOOTER_SIZE;
+}
+
+/*******************************************************************************
+ * This function extracts every member of an archive, or only the named ones, 
+ * into the output directory. Each member is found through the directory and 
+ * decoded in place from the mapped archive.
+*******************************************************************************/
+int extractArchive(codec_context_t *context, const char *archiveName, 
+	char **memberNames, int memberCount, const char *outputDirectory, 
+	const compress_options_t *options)
+{
+	input_source_t source;
+	if(openInputSource(&source, archiveName))
+	{
+		return 1;
+	}
+	archive_list_t list;
+	memset(&list, 0, sizeof(list));
+	int status = 0;
+	if(source.map == NULL)
+	{
+		fprintf(stderr, "Cannot extract from %s, it is not a regular file.\n",
+			archiveName);
+		status = 1;
+	}
+	status = status || readArchiveDirectory(&source, &list);
+
+	/****members are quiet, the archive reports the count. Without an output 
+	directory the members are only tested.****/
+	compress_options_t memberOptions = *options;
+	memberOptions.verbosity = 0;
+	long extracted = 0;
+	long m;
+	if(memberCount == 0 && !status)
+	{
+		for(m=0; m<list.count && (!status || outputDirectory == NULL); m++)
+		{
+			status |= extractMember(context, &source, &list.members[m], 
+				outputDirectory, &memberOptions);
+			extracted++;
+		}
+	}
+	int i;
+	for(i=0; i<memberCount && !status; i++)
+	{
+		for(m=0; m<list.count; m++)
+		{
+			if(strcmp(list.members[m].name, memberNames[i]) == 0)
+			{
+				break;
+			}
+		}
+		if(m == list.count)
+		{
+			fprintf(stderr, "%s is not in the archive.\n", memberNames[i]);
+			status = 1;
+			break;
+		}
+		status = extractMember(context, &source, &list.members[m], 
+			outputDirectory, &memberOptions);
+		extracted++;
+	}
+	if(!status && (*options).verbosity > 0 && outputDirectory != NULL)
+	{
+		fprintf(stderr, " - %ld files extracted to %s\n", extracted, 
+			outputDirectory);
+	}
+	else if(!status && (*options).verbosity > 0)
+	{
+		fprintf(stderr, " - %ld files tested\n", extracted);
+	}
+
+	freeArchiveList(&list);
+	closeInputSource(&source);
+	return status;
+}
+
+/*******************************************************************************
+ * This function decompresses one archive member to its name under the output
+ * directory, creating the directories it needs, or only decodes it without 
+ * an output directory.
+*******************************************************************************/
+int extractMember(codec_context_t *context, const input_source_t *archive, 
+	const archive_member_t *member, const char *outputDirectory, 
+	const compress_options_t *options)
+{
+	if(!memberNameSafe((*member).name))
+	{
+		fprintf(stderr, "Archive member %s has an unsafe name.\n", 
+			(*member).name);
+		return 1;
+	}
+	if(outputDirectory == NULL)
+	{
+		return decompressMember(context, archive, member, NULL, options);
+	}
+	size_t pathLength = strlen(outputDirectory) + strlen((*member).name) + 2;
+	char *path = malloc(pathLength);
+	if(path == NULL)
+	{
+		fprintf(stderr, "Cannot extract file. Memory allocation error.\n");
+		return 1;
+	}
+	snprintf(path, pathLength, "%s/%s", outputDirectory, (*member).name);
+	FILE *fpOut = NULL;
+	if(!makeParentDirectories(path))
+	{
+		fpOut = openOutput(path);
+	}
+	if(fpOut == NULL)
+	{
+		free(path);
+		return 1;
+	}
+	int status = decompressMember(context, archive, member, fpOut, options);
+	status = closeFiles(NULL, fpOut, path, status);
+	free(path);
+	return status;
+}
+
+/*******************************************************************************
+ * This function decompresses an archive member to the output file, or only 
+ * decodes it without one, and checks its length against the directory.
+*******************************************************************************/
+int decompressMember(codec_context_t *context, const input_source_t *archive, 
+	const archive_member_t *member, FILE *fpOut, 
+	const compress_options_t *options)
+{
+	/****the member is a whole compressed file within the archive.****/
+	input_source_t source;
+	memoryInputSource(&source, &(*archive).map[(*member).offset], 
+		(long)(*member).compressedLength);
+	job_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	int status = decompressSource(context, &source, fpOut, options, &stats);
+	if(!status && (uint64_t)stats.bytesOut != (*member).length)
+	{
+		fprintf(stderr, "Archive member %s is corrupt.\n", (*member).name);
+		status = 1;
+	}
+	else if(status)
+	{
+		fprintf(stderr, "Archive member %s cannot be decompressed.\n", 
+			(*member).name);
+	}
+	return status;
+}
+
+/*******************************************************************************
+ * This function prints the length, compressed length and name of each member 
+ * of an archive.
+*******************************************************************************/
+int listArchive(const char *archiveName)
+{
+	input_source_t source;
+	if(openInputSource(&source, archiveName))
+	{
+		return 1;
+	}
+	archive_list_t list;
+	memset(&list, 0, sizeof(list));
+	int status = readArchiveDirectory(&source, &list);
+	long m;
+	for(m=0; m<list.count && !status; m++)
+	{
+		printf("%12" PRIu64 " %12" PRIu64 "  %s\n", list.members[m].length, 
+			list.members[m].compressedLength, list.members[m].name);
+	}
+	freeArchiveList(&list);
+	closeInputSource(&source);
+	return status;
+}
+
+/*******************************************************************************
+ * This function reads and checks the directory at the end of an archive.
+*******************************************************************************/
+int readArchiveDirectory(const input_source_t *source, archive_list_t *list)
+{
+	unsigned char headerBuffer[FILE_HEADER_SIZE];
+	const unsigned char *header;
+	unsigned char footerBuffer[ARCHIVE_FOOTER_SIZE];
+	const unsigned char *footer;
+	int64_t footerOffset = (*source).size - ARCHIVE_FOOTER_SIZE;
+	if(footerOffset < FILE_HEADER_SIZE || readInputAt(source, headerBuffer, 
+		FILE_HEADER_SIZE, 0, &header) != FILE_HEADER_SIZE || 
+		memcmp(header, ARCHIVE_MAGIC, FILE_MAGIC_SIZE) != 0 || 
+		readInputAt(source, footerBuffer, ARCHIVE_FOOTER_SIZE, 
+		(uint64_t)footerOffset, &footer) != ARCHIVE_FOOTER_SIZE || 
+		memcmp(&footer[12], ARCHIVE_DIRECTORY_MAGIC, FILE_MAGIC_SIZE) != 0)
+	{
+		fprintf(stderr, "Not a huffman archive.\n");
+		return 1;
+	}
+	if(header[FILE_MAGIC_SIZE] != FORMAT_VERSION)
+	{
+		fprintf(stderr, "Unsupported format version %d.\n", 
+			header[FILE_MAGIC_SIZE]);
+		return 1;
+	}
+	uint64_t directoryOffset = loadU64(footer);
+	long count = (long)loadU32(&footer[8]);
+	if(directoryOffset < FILE_HEADER_SIZE || 
+		directoryOffset > (uint64_t)footerOffset || (uint64_t)count > 
+		((uint64_t)footerOffset - directoryOffset)/ARCHIVE_ENTRY_SIZE)
+	{
+		fprintf(stderr, "Archive directory is corrupt.\n");
+		return 1;
+	}
+	if(reserveBuffer(&(*list).members, &(*list).capacity, 
+		sizeof(archive_member_t)*(count + 1)))
+	{
+		fprintf(stderr, "Cannot read archive. Memory allocation error.\n");
+		return 1;
+	}
+
+	/****members lie between the header and the directory.****/
+	unsigned char entryBuffer[ARCHIVE_ENTRY_SIZE];
+	const unsigned char *entry;
+	unsigned char nameBuffer[MAX_MEMBER_NAME];
+	const unsigned char *name;
+	uint64_t position = directoryOffset;
+	long i;
+	for(i=0; i<count; i++)
+	{
+		if(readInputAt(source, entryBuffer, ARCHIVE_ENTRY_SIZE, position, 
+			&entry) != ARCHIVE_ENTRY_SIZE)
+		{
+			fprintf(stderr, "Archive directory is corrupt.\n");
+			return 1;
+		}
+		archive_member_t *member = &(*list).members[i];
+		(*member).offset = loadU64(entry);
+		(*member).compressedLength = loadU64(&entry[8]);
+		(*member).length = loadU64(&entry[16]);
+		long nameLength = (long)loadU32(&entry[24]);
+		position += ARCHIVE_ENTRY_SIZE;
+		if(nameLength == 0 || nameLength > MAX_MEMBER_NAME || 
+			position + nameLength > (uint64_t)footerOffset || 
+			(*member).offset < FILE_HEADER_SIZE || 
+			(*member).offset > directoryOffset || 
+			(*member).compressedLength > directoryOffset - (*member).offset ||
+			readInputAt(source, nameBuffer, nameLength, position, &name) != 
+			nameLength || memchr(name, '\0', nameLength) != NULL)
+		{
+			fprintf(stderr, "Archive directory is corrupt.\n");
+			return 1;
+		}
+		(*member).path = malloc(nameLength + 1);
+		if((*member).path == NULL)
+		{
+			fprintf(stderr, "Cannot read archive. Memory allocation error.\n");
+			return 1;
+		}
+		memcpy((*member).path, name, nameLength);
+		(*member).path[nameLength] = '\0';
+		(*member).name = (*member).path;
+		(*member).inputSize = -1;
+		(*list).count++;
+		position += nameLength;
+	}
+	if(position != (uint64_t)footerOffset)
+	{
+		fprintf(stderr, "Archive directory is corrupt.\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function checks that a member name stays under the directory it is 
+ * extracted to: it is relative and has no .. part.
+*******************************************************************************/
+int memberNameSafe(const char *name)
+{
+	if(name[0] == '\0' || name[0] == '/')
+	{
+		return 0;
+	}
+	const char *part = name;
+	while(1)
+	{
+		const char *end = strchr(part, '/');
+		size_t length = end == NULL ? strlen(part) : (size_t)(end - part);
+		if(length == 2 && part[0] == '.' && part[1] == '.')
+		{
+			return 0;
+		}
+		if(end == NULL)
+		{
+			return 1;
+		}
+		part = end + 1;
+	}
+}
+
+/*******************************************************************************
+ * This function creates the missing directories above a file path.
+*******************************************************************************/
+int makeParentDirectories(char *path)
+{
+	char *slash;
+	for(slash=strchr(path + 1, '/'); slash!=NULL; slash=strchr(slash + 1, '/'))
+	{
+		*slash = '\0';
+		int failed = mkdir(path, 0777) != 0 && errno != EEXIST;
+		if(failed)
+		{
+			fprintf(stderr, "Cannot create directory %s.\n", path);
+		}
+		*slash = '/';
+		if(failed)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This function frees the names and entries of an archive list.
+*******************************************************************************/
+void freeArchiveList(archive_list_t *list)
+{
+	long i;
+	for(i=0; i<(*list).count; i++)
+	{
+		free((*list).members[i].path);
+	}
+	free((*list).members);
+	memset(list, 0, sizeof(archive_list_t));
+}
+
+/*******************************************************************************
+ * This function adds the counts, tables and stage times of a member's job to 
+ * the totals of an archive.
+*******************************************************************************/
+void addJobStats(job_stats_t *total, const job_stats_t *stats)
+{
+	(*total).bytesIn += (*stats).bytesIn;
+	(*total).bytesOut += (*stats).bytesOut;
+	(*total).blocks += (*stats).blocks;
+	(*total).tables += (*stats).tables;
+	addStageTimes(&(*total).times, &(*stats).times);
+	int i;
+	for(i=0; i<256; i++)
+	{
+		if((*stats).seen[i] && !(*total).seen[i])
+		{
+			(*total).seen[i] = 1;
+			(*total).symbols++;
+		}
+	}
+	if((*stats).maxCodeLength > (*total).maxCodeLength)
+	{
+		(*total).maxCodeLength = (*stats).maxCodeLength;
+	}
+}
+
+/*******************************************************************************
+ * This function is the pool task building the table of a block of a batch.
+*******************************************************************************/
+void analyseBlockTask(void *context, int index)
+{
+	compress_batch_t *batch = context;
+	block_job_t *job = &(*batch).jobs[index];
+
+	memset(&(*job).times, 0, sizeof(stage_times_t));
+	(*job).status = analyseBlock(job, (*batch).options);
+}
+
+/*******************************************************************************
+ * This function is the pool task encoding a block of a batch.
+*******************************************************************************/
+void encodeBlockTask(void *context, int index)
+{
+	compress_batch_t *batch = context;
+	block_job_t *job = &(*batch).jobs[index];
+	struct timespec clock;
+
+	if((*(*batch).options).stats)
+	{
+		startTimer(&clock);
+	}
+	encodeBlock(job);
+	if((*(*batch).options).checksums)
+	{
+		appendBlockChecksum(job);
+	}
+	if((*(*batch).options).stats)
+	{
+		lapTimer(&clock, &(*job).times.encode);
+	}
+}
+
+/*******************************************************************************
+ * This function counts the chars of a block and chooses how it is coded.
+*******************************************************************************/
+int analyseBlock(block_job_t *job, const compress_options_t *options)
+{
+	countBlock(job, options);
+
+	return chooseBlockCoding(job, options);
+}
+
+/*******************************************************************************
+ * This function chooses how a counted block is coded, from the cheapest 
+ * checks up. A block of one repeated byte is a fill. A block the trained table
+ * codes in no more bits than plain bytes is coded with it. A block whose 
+ * entropy estimate shows no huffman code can beat plain bytes, even one which
+ * stores no table, is stored raw without building a tree. Otherwise the 
+ * block's huffman codes are built, and its order-1 tables when they are asked
+ * for. Whether a single table block is still stored raw is left to 
+ * chooseBlockTable, which knows whether a table would be stored.
+*******************************************************************************/
+int chooseBlockCoding(block_job_t *job, const compress_options_t *options)
+{
+	(*job).order1.groupCount = 0;
+	(*job).dictionary = 0;
+	(*job).storedAs = 0;
+	(*job).limitCostBits = 0;
+	long rawBits = 8*(*job).inputLength;
+	if((*job).noOfUniqueChars == 1)
+	{
+		(*job).storedAs = BLOCK_FLAG_FILL;
+		return 0;
+	}
+	(*job).dictionary = (*options).dictionary != NULL && 
+		trainedTableFits(job, (*(*options).dictionary).codeTable);
+	if((*job).dictionary)
+	{
+		return 0;
+	}
+	if((*options).contextGroups == 1 && estimateBits(job) >= rawBits)
+	{
+		(*job).storedAs = BLOCK_FLAG_RAW;
+		return 0;
+	}
+
+	int status = buildBlockCodes(job, options);
+	if(!status && (*options).contextGroups > 1 && 
+		(*job).inputLength >= MIN_ORDER1_LENGTH)
+	{
+		status = buildOrder1Tables(job, options);
+	}
+	return status;
+}
+
+/*******************************************************************************
+ * This function checks whether a block is coded with a single huffman table, 
+ * its own or the previous block's, rather than the trained table, order-1 
+ * tables or no codes.
+*******************************************************************************/
+int singleTable(const block_job_t *job)
+{
+	return !(*job).dictionary && (*job).order1.groupCount == 0 && 
+		!(*job).storedAs;
+}
+
+/*******************************************************************************
+ * This function estimates the entropy of a counted block in bits, the least 
+ * any table built from its counts can code it in.
+*******************************************************************************/
+long estimateBits(const block_job_t *job)
+{
+	float totalBits = fastLog2((float)(*job).inputLength);
+	float bits = 0;
+	int i;
+	for(i=0; i<(*job).noOfUniqueChars; i++)
+	{
+		bits += (float)(*job).charFreq[i]*(totalBits - 
+			fastLog2((float)(*job).charFreq[i]));
+	}
+	return (long)bits;
+}
+
+/*******************************************************************************
+ * This function returns the bits a code table takes to code a counted block.
+*******************************************************************************/
+long codedBits(const block_job_t *job, const symbol_code_t codeTable[256])
+{
+	long bits = 0;
+	int i;
+	for(i=0; i<(*job).noOfUniqueChars; i++)
+	{
+		bits += (long)(*job).charFreq[i]*
+			codeTable[(*job).uniqueChars[i]].length;
+	}
+	return bits;
+}
+
+/*******************************************************************************
+ * This function checks that a trained table has a code for every char of a 
+ * counted block and codes it in no more bits than plain bytes, which keeps the
+ * block within maxBlockOutputSize.
+*******************************************************************************/
+int trainedTableFits(const block_job_t *job, const symbol_code_t *codeTable)
+{
+	long bits = 0;
+	int i;
+	for(i=0; i<(*job).noOfUniqueChars; i++)
+	{
+		unsigned char c = (*job).uniqueChars[i];
+		if(codeTable[c].length == 0)
+		{
+			return 0;
+		}
+		bits += (long)(*job).charFreq[i]*codeTable[c].length;
+	}
+	return bits <= 8*(*job).inputLength;
+}
+
+/*******************************************************************************
+ * This function counts the chars of a block and picks its stream count.
+*******************************************************************************/
+void countBlock(block_job_t *job, const compress_options_t *options)
+{
+	struct timespec clock;
+	if((*options).stats)
+	{
+		startTimer(&clock);
+	}
+
+	/****store the unique chars and corresponding frequencies in arrays****/
+	(*job).noOfUniqueChars = uniqueCharsFreqCounter((*job).input, 
+		(*job).inputLength, (*job).uniqueChars, (*job).charFreq);
+	if((*options).stats)
+	{
+		lapTimer(&clock, &(*job).times.histogram);
+	}
+	(*job).streamCount = (*options).streamCount == STREAM_COUNT && 
+		(*job).inputLength >= MIN_STREAMS_LENGTH ? STREAM_COUNT : 1;
+}
+
+/*******************************************************************************
+ * This function builds the huffman codes of a counted block.
+*******************************************************************************/
+int buildBlockCodes(block_job_t *job, const compress_options_t *options)
+{
+	(*job).limitCostBits = 0;
+	return generateHuffmanCodes((*job).uniqueChars, (*job).charFreq, 
+		(*job).noOfUniqueChars, (*job).newTable, (*options).maxCodeLength, 
+		&(*job).limitCostBits, (*options).stats ? &(*job).times : NULL);
+}
+
+/*******************************************************************************
+ * This function groups the previous bytes of a counted block by the bytes 
+ * which follow them and builds a table for each group. The groups start from
+ * the most frequent previous bytes, then each previous byte moves to the 
+ * group whose counts code its followers in the fewest estimated bits, for a 
+ * few passes. The order-1 tables are kept, groupCount non zero, only when 
+ * they and the context map take fewer bits than the block's single table and
+ * than plain bytes.
+*******************************************************************************/
+int buildOrder1Tables(block_job_t *job, const compress_options_t *options)
+{
+	order1_tables_t *order1 = &(*job).order1;
+	(*order1).groupCount = 0;
+	struct timespec clock;
+	if((*options).stats)
+	{
+		startTimer(&clock);
+	}
+	uint32_t *pairs = (*job).pairCounts;
+	countPairs(job, pairs);
+
+	/****seed the groups with the most frequent previous bytes.****/
+	long totals[256];
+	int seeded[256];
+	int i;
+	int c;
+	for(i=0; i<256; i++)
+	{
+		totals[i] = 0;
+		for(c=0; c<256; c++)
+		{
+			totals[i] += pairs[256*i + c];
+		}
+		seeded[i] = 0;
+	}
+	unsigned char *groups = (*order1).groups;
+	memset(groups, 0, 256);
+	uint32_t groupCounts[MAX_CONTEXT_GROUPS][256];
+	int groupCount = 0;
+	while(groupCount < (*options).contextGroups)
+	{
+		int seed = -1;
+		for(i=0; i<256; i++)
+		{
+			if(totals[i] > 0 && !seeded[i] && (seed < 0 || 
+				totals[i] > totals[seed]))
+			{
+				seed = i;
+			}
+		}
+		if(seed < 0)
+		{
+			break;
+		}
+		seeded[seed] = 1;
+		memcpy(groupCounts[groupCount], &pairs[256*seed], 
+			sizeof(uint32_t)*256);
+		groupCount++;
+	}
+	if(groupCount < 2)
+	{
+		return 0;
+	}
+
+	/****move each previous byte to its cheapest group, then recount.****/
+	float bits[MAX_CONTEXT_GROUPS][256];
+	int g;
+	int pass;
+	for(pass=0; pass<CONTEXT_PASSES; pass++)
+	{
+		for(g=0; g<groupCount; g++)
+		{
+			long groupTotal = 0;
+			for(c=0; c<256; c++)
+			{
+				groupTotal += groupCounts[g][c];
+			}
+			float totalBits = fastLog2((float)groupTotal + 128.0f);
+			for(c=0; c<256; c++)
+			{
+				bits[g][c] = totalBits - fastLog2((float)groupCounts[g][c] + 
+					0.5f);
+			}
+		}
+		for(i=0; i<256; i++)
+		{
+			if(totals[i] == 0)
+			{
+				continue;
+			}
+			float bestCost = 0;
+			for(g=0; g<groupCount; g++)
+			{
+				float cost = 0;
+				for(c=0; c<256; c++)
+				{
+					cost += (float)pairs[256*i + c]*bits[g][c];
+				}
+				if(g == 0 || cost < bestCost)
+				{
+					bestCost = cost;
+					groups[i] = (unsigned char)g;
+				}
+			}
+		}
+		memset(groupCounts, 0, sizeof(groupCounts));
+		for(i=0; i<256; i++)
+		{
+			for(c=0; c<256; c++)
+			{
+				groupCounts[groups[i]][c] += pairs[256*i + c];
+			}
+		}
+	}
+
+	/****drop empty groups, unseen previous bytes fall in group 0.****/
+	int renumbered[MAX_CONTEXT_GROUPS];
+	int usedGroups = 0;
+	for(g=0; g<groupCount; g++)
+	{
+		long groupTotal = 0;
+		for(c=0; c<256; c++)
+		{
+			groupTotal += groupCounts[g][c];
+		}
+		renumbered[g] = usedGroups;
+		if(groupTotal > 0)
+		{
+			memmove(groupCounts[usedGroups], groupCounts[g], 
+				sizeof(uint32_t)*256);
+			usedGroups++;
+		}
+	}
+	for(i=0; i<256; i++)
+	{
+		groups[i] = totals[i] > 0 ? (unsigned char)renumbered[groups[i]] : 0;
+	}
+	if((*options).stats)
+	{
+		lapTimer(&clock, &(*job).times.histogram);
+	}
+	if(usedGroups < 2)
+	{
+		return 0;
+	}
+
+	/****build each group's table and compare the total with one table.****/
+	long order1Bits = 8*(1 + CONTEXT_MAP_SIZE);
+	for(g=0; g<usedGroups; g++)
+	{
+		unsigned char uniqueChars[256];
+		int charFreq[256];
+		int noOfUniqueChars = 0;
+		for(c=0; c<256; c++)
+		{
+			if(groupCounts[g][c] > 0)
+			{
+				uniqueChars[noOfUniqueChars] = (unsigned char)c;
+				charFreq[noOfUniqueChars] = (int)groupCounts[g][c];
+				noOfUniqueChars++;
+			}
+		}
+		long limitCostBits;
+		if(generateHuffmanCodes(uniqueChars, charFreq, noOfUniqueChars, 
+			(*order1).codeTables[g], (*options).maxCodeLength, &limitCostBits, 
+			(*options).stats ? &(*job).times : NULL))
+		{
+			return 1;
+		}
+		order1Bits += 8*blockTableSize(noOfUniqueChars);
+		for(i=0; i<noOfUniqueChars; i++)
+		{
+			order1Bits += (long)charFreq[i]*
+				(*order1).codeTables[g][uniqueChars[i]].length;
+		}
+	}
+	long singleBits = 8*blockTableSize((*job).noOfUniqueChars) + 
+		codedBits(job, (*job).newTable);
+	if(order1Bits < singleBits && order1Bits < 8*(*job).inputLength)
+	{
+		(*order1).groupCount = usedGroups;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function counts each byte of a block after the byte before it, into a
+ * 256 by 256 array indexed by the previous byte. Each stream starts after a 
+ * zero byte, as the decoder's streams do.
+*******************************************************************************/
+void countPairs(const block_job_t *job, uint32_t *pairs)
+{
+	memset(pairs, 0, sizeof(uint32_t)*256*256);
+	long segmentLength = (*job).inputLength/(*job).streamCount;
+	int k;
+	for(k=0; k<(*job).streamCount; k++)
+	{
+		long start = k*segmentLength;
+		long end = k == (*job).streamCount - 1 ? (*job).inputLength : 
+			start + segmentLength;
+		unsigned int previous = 0;
+		long j;
+		for(j=start; j<end; j++)
+		{
+			pairs[previous << 8 | (*job).input[j]]++;
+			previous = (*job).input[j];
+		}
+	}
+}
+
+/*******************************************************************************
+ * This function returns an estimate of the base 2 logarithm of a positive 
+ * value, from its exponent and a quadratic fit of its mantissa. It is close 
+ * enough to compare code costs and needs no maths library.
+*******************************************************************************/
+float fastLog2(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int exponent = (int)((bits >> 23) & 255) - 127;
+	bits = (bits & 0x007fffff) | 0x3f800000;
+	float mantissa;
+	memcpy(&mantissa, &bits, sizeof(mantissa));
+
+	return (float)exponent + (-0.34484843f*mantissa + 2.02466578f)*mantissa - 
+		0.67487759f;
+}
+
+/*******************************************************************************
+ * This function returns the largest encoded size of a block: its header and 
+ * table, the stream jump table, one byte per input byte as huffman codes never
+ * take more bits than plain bytes, stream padding and room for the bit 
+ * writer's final word.
+*******************************************************************************/
+long maxBlockOutputSize(long blockSize)
+{
+	return BLOCK_HEADER_SIZE + MAX_BLOCK_TABLE_SIZE + STREAM_JUMP_SIZE + 
+		blockSize + STREAM_COUNT + 8 + CHECKSUM_SIZE;
+}
+
+/*******************************************************************************
+ * This function chooses the table a block is coded with. The new table is 
+ * kept unless the previous one codes the block at least as well once the size
+ * of storing the new table is counted. The block is stored raw when neither 
+ * comes out smaller than its plain bytes.
+*******************************************************************************/
+void chooseBlockTable(block_job_t *job, const symbol_code_t *previousTable)
+{
+	long newBits = 8*blockTableSize((*job).noOfUniqueChars);
+	long previousBits = 0;
+	int reuseTable = previousTable != NULL;
+	int i;
+	for(i=0; i<(*job).noOfUniqueChars; i++)
+	{
+		unsigned char c = (*job).uniqueChars[i];
+		newBits += (long)(*job).charFreq[i]*(*job).newTable[c].length;
+		if(reuseTable)
+		{
+			previousBits += (long)(*job).charFreq[i]*previousTable[c].length;
+			if(previousTable[c].length == 0)
+			{
+				reuseTable = 0;
+			}
+		}
+	}
+	if(reuseTable && previousBits > newBits)
+	{
+		reuseTable = 0;
+	}
+	if((reuseTable ? previousBits : newBits) >= 8*(*job).inputLength)
+	{
+		(*job).storedAs = BLOCK_FLAG_RAW;
+		reuseTable = 0;
+	}
+
+	(*job).reuseTable = reuseTable;
+	memcpy((*job).codeTable, reuseTable ? previousTable : (*job).newTable, 
+		sizeof(symbol_code_t)*256);
+}
+
+/*******************************************************************************
+ * This function writes a block's header, its table or order-1 tables unless 
+ * it reuses the previous one or the trained table, and its encoded payload, 
+ * or for a raw or fill block its bytes. 
+ * In four stream mode the block is cut into quarters, the last taking the 
+ * remainder, each coded as its own stream after a jump table of the first 
+ * three stream lengths.
+*******************************************************************************/
+void encodeBlock(block_job_t *job)
+{
+	unsigned char *out = (*job).out;
+	long headerLength = BLOCK_HEADER_SIZE;
+	out[0] = (*job).reuseTable ? BLOCK_FLAG_REUSE_TABLE : 0;
+	if((*job).dictionary)
+	{
+		out[0] = BLOCK_FLAG_DICTIONARY;
+	}
+	int order1 = (*job).order1.groupCount > 0;
+	if(order1)
+	{
+		out[0] = BLOCK_FLAG_ORDER1;
+	}
+	if((*job).streamCount == STREAM_COUNT)
+	{
+		out[0] |= BLOCK_FLAG_FOUR_STREAMS;
+	}
+	storeU32(&out[1], (uint32_t)(*job).inputLength);
+
+	/****raw and fill blocks copy their bytes, or the one byte, as they are.
+	****/
+	if((*job).storedAs)
+	{
+		long payloadLength = (*job).storedAs == BLOCK_FLAG_RAW ? 
+			(*job).inputLength : 1;
+		out[0] = (unsigned char)(*job).storedAs;
+		memcpy(&out[headerLength], (*job).input, payloadLength);
+		storeU32(&out[5], (uint32_t)payloadLength);
+		(*job).payloadBits = 8*payloadLength;
+		(*job).outLength = headerLength + payloadLength;
+		return;
+	}
+	if(order1)
+	{
+		headerLength += writeOrder1Tables(&(*job).order1, &out[headerLength]);
+	}
+	else if(!(*job).reuseTable && !(*job).dictionary)
+	{
+		headerLength += writeBlockTable((*job).codeTable, &out[headerLength]);
+	}
+	const symbol_code_t *codeTables[256];
+	int i;
+	for(i=0; i<256 && order1; i++)
+	{
+		codeTables[i] = (*job).order1.codeTables[(*job).order1.groups[i]];
+	}
+
+	/****encode each stream of the block with the selected table****/
+	unsigned char *payload = &out[headerLength];
+	long payloadLength = (*job).streamCount == STREAM_COUNT ? 
+		STREAM_JUMP_SIZE : 0;
+	long segmentLength = (*job).inputLength/(*job).streamCount;
+	bit_writer_t writer;
+	int k;
+	for(k=0; k<(*job).streamCount; k++)
+	{
+		long start = k*segmentLength;
+		long length = k == (*job).streamCount - 1 ? 
+			(*job).inputLength - start : segmentLength;
+		writer.accumulator = 0;
+		writer.bitCount = 0;
+		writer.position = 0;
+		writer.buffer = &payload[payloadLength];
+		long bits = order1 ? encodeOrder1String(&(*job).input[start], length, 
+			codeTables, &writer) : encodeString(&(*job).input[start], length, 
+			(*job).codeTable, &writer);
+		(*job).payloadBits = payloadLength*8 + bits;
+		if(k < (*job).streamCount - 1)
+		{
+			storeU32(&payload[4*k], (uint32_t)writer.position);
+		}
+		payloadLength += writer.position;
+	}
+	storeU32(&out[5], (uint32_t)payloadLength);
+
+	(*job).outLength = headerLength + payloadLength;
+}
+
+/*******************************************************************************
+ * This function follows a coded block with the checksum of its input, which 
+ * the payload length in its header does not count.
+*******************************************************************************/
+void appendBlockChecksum(block_job_t *job)
+{
+	storeU32(&(*job).out[(*job).outLength], 
+		crc32c(0, (*job).input, (*job).inputLength));
+	(*job).outLength += CHECKSUM_SIZE;
+}
+
+/*******************************************************************************
+ * This function writes an adaptive block, its header and its payload coded 
+ * with the model's codes, adapting the model at each rebuild point. Returns 
+ * the length written, or -1.
+*******************************************************************************/
+long encodeAdaptive(adaptive_model_t *model, const unsigned char *input, 
+	long inputLength, unsigned char *out)
+{
+	out[0] = BLOCK_FLAG_ADAPTIVE;
+	storeU32(&out[1], (uint32_t)inputLength);
+
+	bit_writer_t writer;
+	writer.accumulator = 0;
+	writer.bitCount = 0;
+	writer.position = 0;
+	writer.buffer = &out[BLOCK_HEADER_SIZE];
+	long start = 0;
+	while(start < inputLength)
+	{
+		long length = inputLength - start < (*model).untilRebuild ? 
+			inputLength - start : (*model).untilRebuild;
+		long j;
+		for(j=start; j<start+length; j++)
+		{
+			symbol_code_t entry = (*model).codeTable[input[j]];
+			writeBits(&writer, entry.code, entry.length);
+		}
+		if(adaptModel(model, &input[start], length, NULL))
+		{
+			return -1;
+		}
+		start += length;
+	}
+	flushBits(&writer);
+	storeU32(&out[5], (uint32_t)writer.position);
+
+	return BLOCK_HEADER_SIZE + writer.position;
+}
+
+/*******************************************************************************
+ * This function starts an adaptive model with every byte counted once, and 
+ * builds its codes, and its decode table when one is given.
+*******************************************************************************/
+int initAdaptiveModel(adaptive_model_t *model, decode_table_t *table)
+{
+	int i;
+	for(i=0; i<256; i++)
+	{
+		(*model).symbols[i] = (unsigned char)i;
+		(*model).counts[i] = 1;
+	}
+	(*model).total = 256;
+	(*model).interval = ADAPTIVE_FIRST_INTERVAL;
+	(*model).untilRebuild = 0;
+
+	return adaptModel(model, NULL, 0, table);
+}
+
+/*******************************************************************************
+ * This function adds a coded segment to the model's counts. Once the interval 
+ * has been coded the codes are rebuilt from the counts, halving them first if
+ * they have grown past the limit, and the next interval is doubled. The 
+ * encoder and decoder call this with the same segments so they rebuild at the
+ * same bytes.
+*******************************************************************************/
+int adaptModel(adaptive_model_t *model, const unsigned char *segment, 
+	long length, decode_table_t *table)
+{
+	long j;
+	for(j=0; j<length; j++)
+	{
+		(*model).counts[segment[j]]++;
+	}
+	(*model).total += length;
+	(*model).untilRebuild -= length;
+	if((*model).untilRebuild > 0)
+	{
+		return 0;
+	}
+
+	int i;
+	if((*model).total > ADAPTIVE_COUNT_LIMIT)
+	{
+		(*model).total = 0;
+		for(i=0; i<256; i++)
+		{
+			(*model).counts[i] = ((*model).counts[i] + 1)/2;
+			(*model).total += (*model).counts[i];
+		}
+	}
+	long limitCostBits;
+	if(generateHuffmanCodes((*model).symbols, (*model).counts, 256, 
+		(*model).codeTable, ADAPTIVE_CODE_LENGTH, &limitCostBits, NULL) || 
+		(table != NULL && buildCodeDecodeTable((*model).codeTable, table)))
+	{
+		return 1;
+	}
+	(*model).untilRebuild = (*model).interval;
+	if((*model).interval < ADAPTIVE_MAX_INTERVAL)
+	{
+		(*model).interval *= 2;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function sets up an empty context. Its buffers and worker pool are 
+ * created by the first job which needs them.
+*******************************************************************************/
+void initContext(codec_context_t *context)
+{
+	memset(context, 0, sizeof(codec_context_t));
+}
+
+/*******************************************************************************
+ * This function stops the worker pool of a context and frees its buffers.
+*******************************************************************************/
+void destroyContext(codec_context_t *context)
+{
+	if((*context).poolThreads > 0)
+	{
+		destroyWorkerPool(&(*context).pool);
+	}
+	long jobCount = (*context).decodeJobsCapacity/(long)sizeof(decode_job_t);
+	long i;
+	for(i=0; i<jobCount; i++)
+	{
+		freeDecodeTable(&(*context).decodeJobs[i].decodeTable);
+		freeOrder1Tables(&(*context).decodeJobs[i].order1);
+	}
+	freeDecodeTable(&(*context).decodeTable);
+	freeOrder1Tables(&(*context).order1);
+	free((*context).pairCounts);
+	free((*context).blockJobs);
+	free((*context).decodeJobs);
+	free((*context).inputs);
+	free((*context).outputs);
+	free((*context).payloads);
+	free((*context).entries);
+	free((*context).outputOffsets);
+	initContext(context);
+}
+
+/*******************************************************************************
+ * This function grows a buffer to at least size bytes, keeping its contents 
+ * and zeroing the new bytes. buffer is the address of the buffer pointer. A 
+ * buffer already large enough is left alone, so a reused buffer costs nothing.
+*******************************************************************************/
+int reserveBuffer(void *buffer, long *capacity, long size)
+{
+	if(size <= *capacity)
+	{
+		return 0;
+	}
+	void *old;
+	memcpy(&old, buffer, sizeof(void *));
+	unsigned char *grown = realloc(old, (size_t)size);
+	if(grown == NULL)
+	{
+		return 1;
+	}
+	memset(&grown[*capacity], 0, (size_t)(size - *capacity));
+	memcpy(buffer, &grown, sizeof(void *));
+	*capacity = size;
+	return 0;
+}
+
+/*******************************************************************************
+ * This function makes sure the context's worker pool runs the given number of
+ * threads, restarting it only when the count changes.
+*******************************************************************************/
+int reserveWorkerPool(codec_context_t *context, int threadCount)
+{
+	if((*context).poolThreads == threadCount)
+	{
+		return 0;
+	}
+	if((*context).poolThreads > 0)
+	{
+		destroyWorkerPool(&(*context).pool);
+		(*context).poolThreads = 0;
+	}
+	if(initWorkerPool(&(*context).pool, threadCount))
+	{
+		return 1;
+	}
+	(*context).poolThreads = threadCount;
+	return 0;
+}
+
+/*******************************************************************************
+ * This function starts the threads of a worker pool, one less than the thread
+ * count as the calling thread also runs tasks.
+*******************************************************************************/
+int initWorkerPool(worker_pool_t *pool, int threadCount)
+{
+	(*pool).threadCount = 0;
+	(*pool).task = NULL;
+	(*pool).context = NULL;
+	(*pool).nextIndex = 0;
+	(*pool).taskCount = 0;
+	(*pool).completed = 0;
+	(*pool).generation = 0;
+	(*pool).shutdown = 0;
+	pthread_mutex_init(&(*pool).lock, NULL);
+	pthread_cond_init(&(*pool).workReady, NULL);
+	pthread_cond_init(&(*pool).workDone, NULL);
+
+	int i;
+	for(i=0; i<threadCount-1; i++)
+	{
+		if(pthread_create(&(*pool).threads[i], NULL, workerMain, pool) != 0)
+		{
+			fprintf(stderr, "Cannot start worker thread.\n");
+			destroyWorkerPool(pool);
+			return 1;
+		}
+		(*pool).threadCount++;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function is the loop of a pool thread, running task indexes each time 
+ * a new task is posted.
+*******************************************************************************/
+void *workerMain(void *argument)
+{
+	worker_pool_t *pool = argument;
+	long seenGeneration = 0;
+
+	pthread_mutex_lock(&(*pool).lock);
+	while(1)
+	{
+		while(!(*pool).shutdown && (*pool).generation == seenGeneration)
+		{
+			pthread_cond_wait(&(*pool).workReady, &(*pool).lock);
+		}
+		if((*pool).shutdown)
+		{
+			break;
+		}
+		seenGeneration = (*pool).generation;
+		runTaskIndexes(pool);
+	}
+	pthread_mutex_unlock(&(*pool).lock);
+
+	return NULL;
+}
+
+/*******************************************************************************
+ * This function runs task(context, i) for every i below taskCount across the 
+ * pool and returns once all of them have completed.
+*******************************************************************************/
+void runWorkerPool(worker_pool_t *pool, void (*task)(void *, int), 
+	void *context, int taskCount)
+{
+	pthread_mutex_lock(&(*pool).lock);
+	(*pool).task = task;
+	(*pool).context = context;
+	(*pool).nextIndex = 0;
+	(*pool).taskCount = taskCount;
+	(*pool).completed = 0;
+	(*pool).generation++;
+	pthread_cond_broadcast(&(*pool).workReady);
+
+	runTaskIndexes(pool);
+	while((*pool).completed < taskCount)
+	{
+		pthread_cond_wait(&(*pool).workDone, &(*pool).lock);
+	}
+	pthread_mutex_unlock(&(*pool).lock);
+}
+
+/*******************************************************************************
+ * This function takes task indexes until none are left. It is called with the
+ * pool locked and runs each task unlocked.
+*******************************************************************************/
+void runTaskIndexes(worker_pool_t *pool)
+{
+	while((*pool).nextIndex < (*pool).taskCount)
+	{
+		int index = (*pool).nextIndex++;
+		pthread_mutex_unlock(&(*pool).lock);
+		(*pool).task((*pool).context, index);
+		pthread_mutex_lock(&(*pool).lock);
+		(*pool).completed++;
+		if((*pool).completed == (*pool).taskCount)
+		{
+			pthread_cond_broadcast(&(*pool).workDone);
+		}
+	}
+}
+
+/*******************************************************************************
+ * This function stops and joins the threads of a worker pool.
+*******************************************************************************/
+void destroyWorkerPool(worker_pool_t *pool)
+{
+	pthread_mutex_lock(&(*pool).lock);
+	(*pool).shutdown = 1;
+	pthread_cond_broadcast(&(*pool).workReady);
+	pthread_mutex_unlock(&(*pool).lock);
+
+	int i;
+	for(i=0; i<(*pool).threadCount; i++)
+	{
+		pthread_join((*pool).threads[i], NULL);
+	}
+	pthread_mutex_destroy(&(*pool).lock);
+	pthread_cond_destroy(&(*pool).workReady);
+	pthread_cond_destroy(&(*pool).workDone);
+}
+
+/*******************************************************************************
+ * This function builds the huffman tree of the unique chars and generates 
+ * their codes into the code table indexed by byte value. The tree and code 
+ * stages are timed when times is not NULL.
+*******************************************************************************/
+int generateHuffmanCodes(unsigned char *uniqueChars, int *charFreq, 
+	const int noOfUniqueChars, symbol_code_t codeTable[256], 
+	const int maxCodeLength, long *limitCostBits, stage_times_t *times)
+{
+	struct timespec clock;
+	if(times != NULL)
+	{
+		startTimer(&clock);
+	}
+
+	/****initialise codeArray to store a key_value_pair_t variable storing the 
+	index and huffman code for each unique char.****/
+	key_value_pair_t codeStore[noOfUniqueChars];
+	key_value_pair_t *codeArray[noOfUniqueChars];
+	int ii;
+	for(ii=0;ii<noOfUniqueChars;ii++)
+	{
+		codeArray[ii] = &codeStore[ii];
+		(*codeArray[ii]).uniqueChar = uniqueChars[ii];
+		(*codeArray[ii]).codeLength = 0;
+	}
+
+
+	/****create huffman tree****/
+	node_t nodeArray[2*256 - 1];
+	int indexOfTreeTop = createHuffmanTree(nodeArray, charFreq, 
+		noOfUniqueChars);
+	if(times != NULL)
+	{
+		lapTimer(&clock, &(*times).tree);
+	}
+
+
+	/****find the code lengths from the tree using preorder algorithim.****/
+	preorderGenerationOfHuffmanCode(nodeArray, indexOfTreeTop, 0, 
+		noOfUniqueChars, codeArray);
+
+	/****shorten codes deeper than the limit.****/
+	*limitCostBits = limitCodeLengths(codeArray, charFreq, noOfUniqueChars, 
+		maxCodeLength);
+	buildCodeTable(codeArray, noOfUniqueChars, codeTable);
+
+	/****codes are assigned canonically so only the lengths are stored.****/
+	int status = assignCanonicalCodes(codeTable);
+	if(times != NULL)
+	{
+		lapTimer(&clock, &(*times).codes);
+	}
+	return status;
+}
+
+/*******************************************************************************
+ * This function countes the frequency of unique characters. The unique chars
+ * are listed in byte order.
+*******************************************************************************/
+int uniqueCharsFreqCounter(const unsigned char *inputString, 
+	long inputStringLength, unsigned char *uniqueChars, int *charFreq)
+{
+	uint64_t freq[256];
+	byteHistogram(inputString, inputStringLength, freq);
+
+	int countUniqueChars = 0;
+	int i;
+	for(i=0; i<256; i++)
+	{
+		if(freq[i] != 0)
+		{
+			uniqueChars[countUniqueChars] = (unsigned char)i;
+			charFreq[countUniqueChars] = (int)freq[i];
+			countUniqueChars++;
+		}
+	}
+	return countUniqueChars;
+}
+
+/*******************************************************************************
+ * This function counts every byte value of the data. Consecutive bytes go to
+ * different count tables, so a run of one byte value does not make each
+ * increment wait on the store of the previous one.
+*******************************************************************************/
+void byteHistogram(const unsigned char *data, long length, 
+	uint64_t freq[256])
+{
+	uint32_t counts[HISTOGRAM_TABLES][256];
+	memset(freq, 0, sizeof(uint64_t)*256);
+
+	while(length > 0)
+	{
+		long chunk = length < HISTOGRAM_CHUNK ? length : HISTOGRAM_CHUNK;
+		memset(counts, 0, sizeof(counts));
+
+		long i = 0;
+		for(; i+8<=chunk; i+=8)
+		{
+			uint64_t word;
+			memcpy(&word, &data[i], sizeof(word));
+			counts[0][(unsigned char)word]++;
+			counts[1][(unsigned char)(word >> 8)]++;
+			counts[2][(unsigned char)(word >> 16)]++;
+			counts[3][(unsigned char)(word >> 24)]++;
+			counts[4][(unsigned char)(word >> 32)]++;
+			counts[5][(unsigned char)(word >> 40)]++;
+			counts[6][(unsigned char)(word >> 48)]++;
+			counts[7][(unsigned char)(word >> 56)]++;
+		}
+		for(; i<chunk; i++)
+		{
+			counts[0][data[i]]++;
+		}
+
+		int j;
+		for(j=0; j<256; j++)
+		{
+			int t;
+			for(t=0; t<HISTOGRAM_TABLES; t++)
+			{
+				freq[j] += counts[t][j];
+			}
+		}
+		data += chunk;
+		length -= chunk;
+	}
+}
+
+/*******************************************************************************
+ * This function creates the huffman tree in nodeArray and returns the index of
+ * its top. The leaves are sorted by frequency once, after which the two 
+ * smallest nodes are always at the front of either the sorted leaves or the 
+ * merged nodes, as merged nodes are created in increasing frequency order.
+*******************************************************************************/
+int createHuffmanTree(node_t nodeArray[], const int *charFreq, 
+	const int noOfUniqueChars)
+{
+	/*sort keys hold the frequency above the leaf index.*/
+	uint64_t leafOrder[noOfUniqueChars];
+	int i;
+	for(i=0; i<noOfUniqueChars; i++)
+	{
+		nodeArray[i].freq = charFreq[i];
+		nodeArray[i].charIndex = i;
+		nodeArray[i].largerFreq = -1;
+		nodeArray[i].smallerFreq = -1;
+		leafOrder[i] = ((uint64_t)(unsigned int)charFreq[i] << 32) | 
+			(unsigned int)i;
+	}
+	qsort(leafOrder, noOfUniqueChars, sizeof(uint64_t), compareFreqKeys);
+
+	int leafFront = 0;
+	int internalFront = noOfUniqueChars;
+	int internalEnd = noOfUniqueChars;
+	int j;
+	for(j=0; j<(noOfUniqueChars-1); j++)
+	{
+		int smallest = nextSmallestIndex(nodeArray, leafOrder, &leafFront, 
+			noOfUniqueChars, &internalFront, internalEnd);
+		int secondSmall = nextSmallestIndex(nodeArray, leafOrder, &leafFront, 
+			noOfUniqueChars, &internalFront, internalEnd);
+		nodeArray[internalEnd].freq = nodeArray[smallest].freq + 
+			nodeArray[secondSmall].freq;
+		nodeArray[internalEnd].charIndex = -1; /*added nodes take index of -1 
+		as a huffman code is not to be generated for them.*/
+		nodeArray[internalEnd].largerFreq = secondSmall;
+		nodeArray[internalEnd].smallerFreq = smallest;
+		internalEnd++;
+	}
+
+	return internalEnd - 1;
+}
+
+/*******************************************************************************
+ * This function orders frequency sort keys.
+*******************************************************************************/
+int compareFreqKeys(const void *a, const void *b)
+{
+	uint64_t keyA = *(const uint64_t *)a;
+	uint64_t keyB = *(const uint64_t *)b;
+
+	return (keyA > keyB) - (keyA < keyB);
+}
+
+/*******************************************************************************
+ * This function takes the node with the next smallest frequency from the 
+ * front of the sorted leaves or of the merged nodes.
+*******************************************************************************/
+int nextSmallestIndex(const node_t nodeArray[], const uint64_t *leafOrder, 
+	int *leafFront, const int noOfUniqueChars, int *internalFront, 
+	const int internalEnd)
+{
+	if(*leafFront < noOfUniqueChars && (*internalFront == internalEnd || 
+		nodeArray[(uint32_t)leafOrder[*leafFront]].freq <= 
+		nodeArray[*internalFront].freq))
+	{
+		return (int)(uint32_t)leafOrder[(*leafFront)++];
+	}
+
+	return (*internalFront)++;
+}
+
+/*******************************************************************************
+ * This function uses the preorder tree algorithim to fill the code length of 
+ * each unique char in the code array.   
+*******************************************************************************/
+void preorderGenerationOfHuffmanCode(const node_t nodeArray[], int tree, 
+	int codeIndex, const int noOfUniqueChars, key_value_pair_t *codeArray[])
+{
+	if(nodeArray[tree].smallerFreq != -1)
+	{
+		preorderGenerationOfHuffmanCode(nodeArray, nodeArray[tree].smallerFreq, 
+			codeIndex + 1, noOfUniqueChars, codeArray);
+	}
+	if(nodeArray[tree].largerFreq != -1)
+	{
+		preorderGenerationOfHuffmanCode(nodeArray, nodeArray[tree].largerFreq, 
+			codeIndex + 1, noOfUniqueChars, codeArray);
+	}
+
+	/*if node is a leaf node*/
+	if(nodeArray[tree].charIndex != -1)
+	{
+		/*a single unique char still needs one bit per occurrence.*/
+		if(noOfUniqueChars == 1)
+		{
+			codeIndex = 1;
+		}
+
+		(*codeArray[nodeArray[tree].charIndex]).codeLength = codeIndex;
+	}
+
+	return;
+}
+
+/*******************************************************************************
+ * This function limits the code lengths to maxCodeLength and returns the extra
+ * bits this costs. Codes deeper than the limit are moved up to it, then while
+ * the code space is over full a code at the limit is removed and a shorter 
+ * code split into two one bit longer. The resulting lengths are handed out 
+ * shortest first to the most frequent chars.
+*******************************************************************************/
+long limitCodeLengths(key_value_pair_t *codeArray[], const int *charFreq, 
+	const int noOfUniqueChars, const int maxCodeLength)
+{
+	int lengthCount[MAX_TREE_DEPTH + 1];
+	memset(lengthCount, 0, sizeof(lengthCount));
+	long unlimitedBits = 0;
+	int deepest = 0;
+	int i;
+	for(i=0; i<noOfUniqueChars; i++)
+	{
+		int length = (*codeArray[i]).codeLength;
+		lengthCount[length]++;
+		unlimitedBits += (long)charFreq[i]*length;
+		if(length > deepest)
+		{
+			deepest = length;
+		}
+	}
+	if(deepest <= maxCodeLength)
+	{
+		return 0;
+	}
+
+	/*Kraft sum in units of the longest allowed code.*/
+	uint64_t kraftSum = 0;
+	int length;
+	for(length=maxCodeLength+1; length<=deepest; length++)
+	{
+		lengthCount[maxCodeLength] += lengthCount[length];
+		lengthCount[length] = 0;
+	}
+	for(length=1; length<=maxCodeLength; length++)
+	{
+		kraftSum += (uint64_t)lengthCount[length] << (maxCodeLength - length);
+	}
+	while(kraftSum > ((uint64_t)1 << maxCodeLength))
+	{
+		lengthCount[maxCodeLength]--;
+		for(length=maxCodeLength-1; length>0; length--)
+		{
+			if(lengthCount[length] != 0)
+			{
+				lengthCount[length]--;
+				lengthCount[length + 1] += 2;
+				break;
+			}
+		}
+		kraftSum--;
+	}
+
+	/*most frequent chars first, which is the reverse of the sorted keys.*/
+	uint64_t freqOrder[noOfUniqueChars];
+	for(i=0; i<noOfUniqueChars; i++)
+	{
+		freqOrder[i] = ((uint64_t)(unsigned int)charFreq[i] << 32) | 
+			(unsigned int)i;
+	}
+	qsort(freqOrder, noOfUniqueChars, sizeof(uint64_t), compareFreqKeys);
+
+	long limitedBits = 0;
+	int next = noOfUniqueChars - 1;
+	for(length=1; length<=maxCodeLength; length++)
+	{
+		int n;
+		for(n=0; n<lengthCount[length]; n++)
+		{
+			int charIndex = (int)(uint32_t)freqOrder[next--];
+			(*codeArray[charIndex]).codeLength = length;
+			limitedBits += (long)charFreq[charIndex]*length;
+		}
+	}
+
+	return limitedBits - unlimitedBits;
+}
+
+/*******************************************************************************
+ * This function assigns canonical codes from the code lengths in the table: 
+ * codes of each length are consecutive, in byte value order, and follow on 
+ * from the shorter codes. Returns 1 if the lengths cannot form a prefix code.
+*******************************************************************************/
+int assignCanonicalCodes(symbol_code_t codeTable[256])
+{
+	int lengthCount[MAX_CODE_LENGTH + 1];
+	memset(lengthCount, 0, sizeof(lengthCount));
+	int noOfUniqueChars = 0;
+	int i;
+	for(i=0; i<256; i++)
+	{
+		if(codeTable[i].length < 0 || codeTable[i].length > MAX_CODE_LENGTH)
+		{
+			return 1;
+		}
+		if(codeTable[i].length > 0)
+		{
+			lengthCount[codeTable[i].length]++;
+			noOfUniqueChars++;
+		}
+	}
+
+	/*Kraft sum in units of the longest code, must not exceed one and must be
+	exactly one unless there is a single char.*/
+	uint64_t kraftSum = 0;
+	uint64_t nextCode[MAX_CODE_LENGTH + 1];
+	uint64_t code = 0;
+	int length;
+	for(length=1; length<=MAX_CODE_LENGTH; length++)
+	{
+		kraftSum += (uint64_t)lengthCount[length] << (MAX_CODE_LENGTH - length);
+		nextCode[length] = code;
+		code = (code + lengthCount[length]) << 1;
+	}
+	if(kraftSum > ((uint64_t)1 << MAX_CODE_LENGTH) || (noOfUniqueChars > 1 && 
+		kraftSum != ((uint64_t)1 << MAX_CODE_LENGTH)))
+	{
+		return 1;
+	}
+
+	for(i=0; i<256; i++)
+	{
+		if(codeTable[i].length > 0)
+		{
+			codeTable[i].code = (unsigned int)nextCode[codeTable[i].length]++;
+		}
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function writes a block's table: the number of unique chars less one, 
+ * the unique chars themselves (as a list when there are fewer than 
+ * TABLE_BITMAP_SIZE, otherwise as a bitmap of the byte values), then the 
+ * length of each char's code, packed.
+*******************************************************************************/
+long writeBlockTable(const symbol_code_t codeTable[256], unsigned char *out)
+{
+	int noOfUniqueChars = 0;
+	int i;
+	for(i=0; i<256; i++)
+	{
+		noOfUniqueChars += codeTable[i].length > 0;
+	}
+	out[0] = (unsigned char)(noOfUniqueChars - 1);
+
+	long position = 1;
+	if(noOfUniqueChars < TABLE_BITMAP_SIZE)
+	{
+		for(i=0; i<256; i++)
+		{
+			if(codeTable[i].length > 0)
+			{
+				out[position++] = (unsigned char)i;
+			}
+		}
+	}
+	else
+	{
+		memset(&out[1], 0, TABLE_BITMAP_SIZE);
+		for(i=0; i<256; i++)
+		{
+			if(codeTable[i].length > 0)
+			{
+				out[1 + (i >> 3)] |= (unsigned char)(1 << (i & 7));
+			}
+		}
+		position += TABLE_BITMAP_SIZE;
+	}
+
+	bit_writer_t writer;
+	writer.accumulator = 0;
+	writer.bitCount = 0;
+	writer.position = 0;
+	writer.buffer = &out[position];
+	for(i=0; i<256; i++)
+	{
+		if(codeTable[i].length > 0)
+		{
+			writeBits(&writer, (unsigned int)(codeTable[i].length - 1), 
+				TABLE_LENGTH_BITS);
+		}
+	}
+	flushBits(&writer);
+
+	return position + writer.position;
+}
+
+/*******************************************************************************
+ * This function returns the stored size of a table with the given number of 
+ * unique chars.
+*******************************************************************************/
+long blockTableSize(const int noOfUniqueChars)
+{
+	long charsSize = noOfUniqueChars < TABLE_BITMAP_SIZE ? noOfUniqueChars : 
+		TABLE_BITMAP_SIZE;
+
+	return 1 + charsSize + ((long)noOfUniqueChars*TABLE_LENGTH_BITS + 7)/8;
+}
+
+/*******************************************************************************
+ * This function stores the order-1 tables of a block: the group count, the 
+ * group of each previous byte two to a byte, then each group's table. Returns
+ * the stored size.
+*******************************************************************************/
+long writeOrder1Tables(const order1_tables_t *order1, unsigned char *out)
+{
+	out[0] = (unsigned char)(*order1).groupCount;
+	int i;
+	for(i=0; i<CONTEXT_MAP_SIZE; i++)
+	{
+		out[1 + i] = (unsigned char)((*order1).groups[2*i] | 
+			(*order1).groups[2*i + 1] << 4);
+	}
+	long length = 1 + CONTEXT_MAP_SIZE;
+	int g;
+	for(g=0; g<(*order1).groupCount; g++)
+	{
+		length += writeBlockTable((*order1).codeTables[g], &out[length]);
+	}
+
+	return length;
+}
+
+/*******************************************************************************
+ * This function prints the huffman code of each byte value in the table.
+*******************************************************************************/
+void printHuffmanCodes(const symbol_code_t codeTable[256])
+{
+	int l;
+	for(l=0;l<256;l++)
+	{
+		char hc[MAX_CODE_LENGTH + 1];
+		int length = codeTable[l].length;
+		if(length == 0)
+		{
+			continue;
+		}
+		int i;
+		for(i=0; i<length; i++)
+		{
+			hc[i] = ((codeTable[l].code >> (length - 1 - i)) & 1) ? '1' : '0';
+		}
+		hc[i] = '\0';
+		fprintf(stderr, "c: %c, code: %s\n", l, hc);
+	}
+}
+
+/*******************************************************************************
+ * This function builds the code table indexed by byte value.
+*******************************************************************************/
+void buildCodeTable(key_value_pair_t *codeArray[], const int noOfUniqueChars, 
+	symbol_code_t codeTable[256])
+{
+	memset(codeTable, 0, sizeof(symbol_code_t)*256);
+	int i;
+	for(i=0; i<noOfUniqueChars; i++)
+	{
+		codeTable[(*codeArray[i]).uniqueChar].length = 
+			(*codeArray[i]).codeLength;
+	}
+}
+
+/*******************************************************************************
+ * This function stores a 32 bit value least significant byte first.
+*******************************************************************************/
+void storeU32(unsigned char *buffer, uint32_t value)
+{
+	buffer[0] = (unsigned char)value;
+	buffer[1] = (unsigned char)(value >> 8);
+	buffer[2] = (unsigned char)(value >> 16);
+	buffer[3] = (unsigned char)(value >> 24);
+}
+
+/*******************************************************************************
+ * This function loads a 32 bit value stored least significant byte first.
+*******************************************************************************/
+uint32_t loadU32(const unsigned char *buffer)
+{
+	return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | 
+		((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+/*******************************************************************************
+ * This function stores a 64 bit value least significant byte first.
+*******************************************************************************/
+void storeU64(unsigned char *buffer, uint64_t value)
+{
+	storeU32(buffer, (uint32_t)value);
+	storeU32(&buffer[4], (uint32_t)(value >> 32));
+}
+
+/*******************************************************************************
+ * This function loads a 64 bit value stored least significant byte first.
+*******************************************************************************/
+uint64_t loadU64(const unsigned char *buffer)
+{
+	return (uint64_t)loadU32(buffer) | ((uint64_t)loadU32(&buffer[4]) << 32);
+}
+
+/*******************************************************************************
+ * This function extends a CRC32C over the data, starting from 0 or from the 
+ * checksum of the bytes before it. SSE4.2 computes it when the CPU has it.
+*******************************************************************************/
+uint32_t crc32c(uint32_t crc, const unsigned char *data, long length)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	if(__builtin_cpu_supports("sse4.2"))
+	{
+		return crc32cHardware(crc, data, length);
+	}
+#endif
+	return crc32cSoftware(crc, data, length);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/*******************************************************************************
+ * This function extends a CRC32C with the SSE4.2 crc32 instruction, a word at
+ * a time.
+*******************************************************************************/
+__attribute__((target("sse4.2"))) 
+uint32_t crc32cHardware(uint32_t crc, const unsigned char *data, long length)
+{
+	uint64_t value = ~crc;
+	while(length >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, data, 8);
+		value = __builtin_ia32_crc32di(value, word);
+		data += 8;
+		length -= 8;
+	}
+	uint32_t value32 = (uint32_t)value;
+	while(length > 0)
+	{
+		value32 = __builtin_ia32_crc32qi(value32, *data);
+		data++;
+		length--;
+	}
+
+	return ~value32;
+}
+#endif
+
+/*******************************************************************************
+ * This function extends a CRC32C without hardware support, eight bytes a step
+ * through a table per byte of the step.
+*******************************************************************************/
+uint32_t crc32cSoftware(uint32_t crc, const unsigned char *data, long length)
+{
+	pthread_once(&crc32cTablesOnce, initCrc32cTables);
+	crc = ~crc;
+	while(length >= CRC32C_SLICES)
+	{
+		uint32_t low = crc ^ loadU32(data);
+		uint32_t high = loadU32(&data[4]);
+		crc = crc32cTables[7][low & 0xff] ^ crc32cTables[6][(low >> 8) & 0xff] ^
+			crc32cTables[5][(low >> 16) & 0xff] ^ crc32cTables[4][low >> 24] ^ 
+			crc32cTables[3][high & 0xff] ^ crc32cTables[2][(high >> 8) & 0xff] ^
+			crc32cTables[1][(high >> 16) & 0xff] ^ crc32cTables[0][high >> 24];
+		data += CRC32C_SLICES;
+		length -= CRC32C_SLICES;
+	}
+	while(length > 0)
+	{
+		crc = crc32cTables[0][(crc ^ *data) & 0xff] ^ (crc >> 8);
+		data++;
+		length--;
+	}
+
+	return ~crc;
+}
+
+/*******************************************************************************
+ * This function builds the software checksum tables. Table k holds the CRC of
+ * each byte value followed by k zero bytes.
+*******************************************************************************/
+void initCrc32cTables(void)
+{
+	int i;
+	for(i=0; i<256; i++)
+	{
+		uint32_t crc = (uint32_t)i;
+		int bit;
+		for(bit=0; bit<8; bit++)
+		{
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLYNOMIAL : 0);
+		}
+		crc32cTables[0][i] = crc;
+	}
+	int k;
+	for(k=1; k<CRC32C_SLICES; k++)
+	{
+		for(i=0; i<256; i++)
+		{
+			uint32_t crc = crc32cTables[k - 1][i];
+			crc32cTables[k][i] = crc32cTables[0][crc & 0xff] ^ (crc >> 8);
+		}
+	}
+}
+
+/*******************************************************************************
+ * This function stores a 64 bit word most significant byte first.
+*******************************************************************************/
+void storeWordBigEndian(unsigned char *buffer, uint64_t word)
+{
+	int i;
+	for(i=0; i<8; i++)
+	{
+		buffer[i] = (unsigned char)(word >> (56 - 8*i));
+	}
+}
+
+/*******************************************************************************
+ * This function appends a code of at most 32 bits to the bit writer. When the
+ * accumulator fills, its 64 bits are flushed to the buffer as one word.
+*******************************************************************************/
+void writeBits(bit_writer_t *writer, unsigned int code, int length)
+{
+	int space = 64 - (*writer).bitCount;
+	if(length < space)
+	{
+		(*writer).accumulator = ((*writer).accumulator << length) | code;
+		(*writer).bitCount += length;
+		return;
+	}
+
+	int rest = length - space;
+	(*writer).accumulator = ((*writer).accumulator << space) | 
+		((uint64_t)code >> rest);
+	storeWordBigEndian(&(*writer).buffer[(*writer).position], 
+		(*writer).accumulator);
+	(*writer).position += 8;
+	(*writer).accumulator = code & (((uint64_t)1 << rest) - 1);
+	(*writer).bitCount = rest;
+}
+
+/*******************************************************************************
+ * This function flushes the pending bits, padding the last byte with zeros.
+*******************************************************************************/
+void flushBits(bit_writer_t *writer)
+{
+	if((*writer).bitCount == 0)
+	{
+		return;
+	}
+	uint64_t word = (*writer).accumulator << (64 - (*writer).bitCount);
+	int i;
+	for(i=0; i<((*writer).bitCount + 7)/8; i++)
+	{
+		(*writer).buffer[(*writer).position++] = (unsigned char)(word >> 
+			(56 - 8*i));
+	}
+	(*writer).accumulator = 0;
+	(*writer).bitCount = 0;
+}
+
+/*******************************************************************************
+ * This function encodes the input string into the bit writer and returns the
+ * number of bits written.
+*******************************************************************************/
+long encodeString(const unsigned char *inputString, long inputStringLength, 
+	const symbol_code_t codeTable[256], bit_writer_t *writer)
+{ 
+	long bits = (*writer).position*8 + (*writer).bitCount;
+	long j;
+	for(j=0; j<inputStringLength; j++)
+	{
+		symbol_code_t entry = codeTable[inputString[j]];
+		writeBits(writer, entry.code, entry.length);
+	}
+	bits = (*writer).position*8 + (*writer).bitCount - bits;
+	flushBits(writer);
+
+	return bits;
+}
+
+/*******************************************************************************
+ * This function encodes the input string into the bit writer, each byte with
+ * the table picked by the byte before it, and returns the number of bits 
+ * written. The string starts after a zero byte.
+*******************************************************************************/
+long encodeOrder1String(const unsigned char *inputString, 
+	long inputStringLength, const symbol_code_t *const codeTables[256], 
+	bit_writer_t *writer)
+{
+	long bits = (*writer).position*8 + (*writer).bitCount;
+	unsigned char previous = 0;
+	long j;
+	for(j=0; j<inputStringLength; j++)
+	{
+		symbol_code_t entry = codeTables[previous][inputString[j]];
+		writeBits(writer, entry.code, entry.length);
+		previous = inputString[j];
+	}
+	bits = (*writer).position*8 + (*writer).bitCount - bits;
+	flushBits(writer);
+
+	return bits;
+}
+
+/*******************************************************************************
+ * This function builds the multi level decode tables from the huffman codes. 
+ * Codes no longer than the root width are resolved by a single lookup, longer 
+ * codes link to next level tables indexed by the following bits.
+*******************************************************************************/
+int buildDecodeTable(const unsigned char *symbols, const unsigned int *codes,
+	const int *codeLengths, const int noOfUniqueChars, decode_table_t *table)
+{
+	decode_symbol_t sorted[noOfUniqueChars];
+	int maxLength = 0;
+	int i;
+	for(i=0; i<noOfUniqueChars; i++)
+	{
+		if(codeLengths[i] < 1 || codeLengths[i] > MAX_CODE_LENGTH)
+		{
+			fprintf(stderr, "Invalid huffman code length %d.\n", 
+				codeLengths[i]);
+			return 1;
+		}
+		sorted[i].alignedCode = codes[i] << (32 - codeLengths[i]);
+		sorted[i].length = codeLengths[i];
+		sorted[i].symbol = symbols[i];
+		if(codeLengths[i] > maxLength)
+		{
+			maxLength = codeLengths[i];
+		}
+	}
+	qsort(sorted, noOfUniqueChars, sizeof(decode_symbol_t), 
+		compareDecodeSymbols);
+
+	/****the entries of the previous table are reused when large enough.****/
+	(*table).rootBits = maxLength < DECODE_ROOT_BITS ? maxLength : 
+		DECODE_ROOT_BITS;
+	(*table).entryCount = 1 << (*table).rootBits;
+	if(reserveBuffer(&(*table).entries, &(*table).capacity, 
+		sizeof(decode_entry_t)*(*table).entryCount))
+	{
+		fprintf(stderr, "Cannot build decode table. Memory allocation error.\n");
+		return 1;
+	}
+	memset((*table).entries, 0, sizeof(decode_entry_t)*(*table).entryCount);
+
+	return fillDecodeLevel(table, sorted, noOfUniqueChars, 0, 0, 
+		(*table).rootBits);
+}
+
+/*******************************************************************************
+ * This function builds the decode tables of the codes in a code table indexed
+ * by byte value.
+*******************************************************************************/
+int buildCodeDecodeTable(const symbol_code_t codeTable[256], 
+	decode_table_t *table)
+{
+	unsigned char symbols[256];
+	unsigned int codes[256];
+	int codeLengths[256];
+	int n = 0;
+	int i;
+	for(i=0; i<256; i++)
+	{
+		if(codeTable[i].length > 0)
+		{
+			symbols[n] = (unsigned char)i;
+			codes[n] = codeTable[i].code;
+			codeLengths[n] = codeTable[i].length;
+			n++;
+		}
+	}
+
+	return buildDecodeTable(symbols, codes, codeLengths, n, table);
+}
+
+/*******************************************************************************
+ * This function orders decode symbols by their left aligned code.
+*******************************************************************************/
+int compareDecodeSymbols(const void *a, const void *b)
+{
+	unsigned int codeA = (*(const decode_symbol_t *)a).alignedCode;
+	unsigned int codeB = (*(const decode_symbol_t *)b).alignedCode;
+
+	return (codeA > codeB) - (codeA < codeB);
+}
+
+/*******************************************************************************
+ * This function fills one level of the decode table. Symbols are sorted by 
+ * code so the codes sharing an index of this level are adjacent and are moved
+ * together into a next level table.
+*******************************************************************************/
+int fillDecodeLevel(decode_table_t *table, const decode_symbol_t *symbols, 
+	int count, int prefixLength, int tableOffset, int tableBits)
+{
+	int i = 0;
+	while(i < count)
+	{
+		unsigned int index = (symbols[i].alignedCode << prefixLength) >> 
+			(32 - tableBits);
+		int remaining = symbols[i].length - prefixLength;
+
+		if(remaining <= tableBits)
+		{
+			/*the code is resolved here, fill every index it prefixes.*/
+			int span = 1 << (tableBits - remaining);
+			int j;
+			for(j=0; j<span; j++)
+			{
+				decode_entry_t *entry = &(*table).entries[tableOffset + 
+					(int)index + j];
+				(*entry).value = symbols[i].symbol;
+				(*entry).length = (unsigned char)remaining;
+				(*entry).subBits = 0;
+			}
+			i++;
+			continue;
+		}
+
+		/*group the longer codes sharing this index.*/
+		int groupEnd = i;
+		int maxLength = 0;
+		while(groupEnd < count && ((symbols[groupEnd].alignedCode << 
+			prefixLength) >> (32 - tableBits)) == index)
+		{
+			if(symbols[groupEnd].length > maxLength)
+			{
+				maxLength = symbols[groupEnd].length;
+			}
+			groupEnd++;
+		}
+
+		int subBits = maxLength - prefixLength - tableBits;
+		if(subBits > DECODE_ROOT_BITS)
+		{
+			subBits = DECODE_ROOT_BITS;
+		}
+		int subOffset = (*table).entryCount;
+		if(reserveBuffer(&(*table).entries, &(*table).capacity, 
+			sizeof(decode_entry_t)*(subOffset + (1 << subBits))))
+		{
+			fprintf(stderr, "Cannot build decode table. Memory allocation "
+				"error.\n");
+			return 1;
+		}
+		memset(&(*table).entries[subOffset], 0, 
+			sizeof(decode_entry_t)*(1 << subBits));
+		(*table).entryCount = subOffset + (1 << subBits);
+
+		decode_entry_t *link = &(*table).entries[tableOffset + (int)index];
+		(*link).value = (unsigned int)subOffset;
+		(*link).length = 0;
+		(*link).subBits = (unsigned char)subBits;
+
+		if(fillDecodeLevel(table, &symbols[i], groupEnd - i, 
+			prefixLength + tableBits, subOffset, subBits))
+		{
+			return 1;
+		}
+		i = groupEnd;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function frees the decode tables.
+*******************************************************************************/
+void freeDecodeTable(decode_table_t *table)
+{
+	free((*table).entries);
+	(*table).entries = NULL;
+	(*table).entryCount = 0;
+	(*table).capacity = 0;
+}
+
+/*******************************************************************************
+ * This function frees the decode tables of a set of order-1 tables.
+*******************************************************************************/
+void freeOrder1Tables(order1_tables_t *order1)
+{
+	int g;
+	for(g=0; g<MAX_CONTEXT_GROUPS; g++)
+	{
+		freeDecodeTable(&(*order1).decodeTables[g]);
+	}
+	(*order1).groupCount = 0;
+}
+
+/*******************************************************************************
+ * This function initialises a bit reader over a block payload.
+*******************************************************************************/
+void initBitReader(bit_reader_t *reader, const unsigned char *block, 
+	long blockLength)
+{
+	(*reader).bitBuffer = 0;
+	(*reader).bitCount = 0;
+	(*reader).block = block;
+	(*reader).blockLength = blockLength;
+	(*reader).blockPosition = 0;
+}
+
+/*******************************************************************************
+ * This function loads a 64 bit word stored most significant byte first.
+*******************************************************************************/
+uint64_t loadWordBigEndian(const unsigned char *buffer)
+{
+	uint64_t word = 0;
+	int i;
+	for(i=0; i<8; i++)
+	{
+		word = (word << 8) | buffer[i];
+	}
+	return word;
+}
+
+/*******************************************************************************
+ * This function tops up the bit buffer to at least 57 bits. Past the end of 
+ * the payload zero bits are supplied and bitCount goes negative as they are 
+ * consumed, which the decoder reports as truncated input.
+*******************************************************************************/
+static inline void refillBits(bit_reader_t *reader)
+{
+	if((*reader).bitCount > 56)
+	{
+		return;
+	}
+
+	/*fast path, take whole bytes from an 8 byte load.*/
+	if((*reader).blockLength - (*reader).blockPosition >= 8 && 
+		(*reader).bitCount >= 0)
+	{
+		uint64_t word = loadWordBigEndian(&(*reader).block[
+			(*reader).blockPosition]);
+		int bytes = (64 - (*reader).bitCount) >> 3;
+		(*reader).bitBuffer |= word >> (*reader).bitCount;
+		(*reader).blockPosition += bytes;
+		(*reader).bitCount += bytes*8;
+		return;
+	}
+
+	while((*reader).bitCount <= 56 && 
+		(*reader).blockPosition < (*reader).blockLength)
+	{
+		if((*reader).bitCount >= 0)
+		{
+			(*reader).bitBuffer |= (uint64_t)(*reader).block[
+				(*reader).blockPosition] << (56 - (*reader).bitCount);
+		}
+		(*reader).blockPosition++;
+		(*reader).bitCount += 8;
+	}
+}
+
+/*******************************************************************************
+ * This function consumes and returns the next count bits (at most 32).
+*******************************************************************************/
+unsigned int readBits(bit_reader_t *reader, int count)
+{
+	refillBits(reader);
+	unsigned int value = (unsigned int)((*reader).bitBuffer >> (64 - count));
+	(*reader).bitBuffer <<= count;
+	(*reader).bitCount -= count;
+
+	return value;
+}
+
+/*******************************************************************************
+ * This function decodes one symbol from the bit reader, one table lookup per 
+ * level. Returns -1 for an invalid code or a read past the payload.
+*******************************************************************************/
+static inline int decodeSymbol(bit_reader_t *reader, 
+	const decode_table_t *table)
+{
+	refillBits(reader);
+
+	/****most codes resolve in the root table, longer ones walk subtables.****/
+	const decode_entry_t *entries = (*table).entries;
+	int tableBits = (*table).rootBits;
+	decode_entry_t entry = entries[(*reader).bitBuffer >> (64 - tableBits)];
+	while(entry.length == 0 && entry.subBits != 0)
+	{
+		(*reader).bitBuffer <<= tableBits;
+		(*reader).bitCount -= tableBits;
+		int tableOffset = (int)entry.value;
+		tableBits = entry.subBits;
+		entry = entries[tableOffset + 
+			(int)((*reader).bitBuffer >> (64 - tableBits))];
+	}
+
+	(*reader).bitBuffer <<= entry.length;
+	(*reader).bitCount -= entry.length;
+	if(entry.length == 0 || (*reader).bitCount < 0)
+	{
+		return -1;
+	}
+	return (int)entry.value;
+}
+
+/*******************************************************************************
+ * This function decodes the packed bitstream from the bit reader into the 
+ * preallocated output buffer.
+*******************************************************************************/
+long decodeString(bit_reader_t *reader, unsigned char *decompressedOut, 
+	long decompressedOutLength, const decode_table_t *table)
+{
+	long j;
+	for(j=0; j<decompressedOutLength; j++)
+	{
+		int symbol = decodeSymbol(reader, table);
+		if(symbol < 0)
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return -1;
+		}
+		decompressedOut[j] = (unsigned char)symbol;
+	}
+
+	return j;
+}
+
+/*******************************************************************************
+ * This function decodes a four stream payload. The four readers advance in 
+ * the same loop so their lookups do not wait on each other, and the last 
+ * stream finishes its remainder alone.
+*******************************************************************************/
+int decodeStreams(const unsigned char *payload, long payloadLength, 
+	unsigned char *decompressedOut, long decompressedOutLength, 
+	const decode_table_t *table)
+{
+	bit_reader_t readers[STREAM_COUNT];
+	if(openStreams(payload, payloadLength, readers))
+	{
+		return 1;
+	}
+
+	long segmentLength = decompressedOutLength/STREAM_COUNT;
+	unsigned char *out0 = decompressedOut;
+	unsigned char *out1 = &decompressedOut[segmentLength];
+	unsigned char *out2 = &decompressedOut[2*segmentLength];
+	unsigned char *out3 = &decompressedOut[3*segmentLength];
+	long j;
+	for(j=0; j<segmentLength; j++)
+	{
+		int symbol0 = decodeSymbol(&readers[0], table);
+		int symbol1 = decodeSymbol(&readers[1], table);
+		int symbol2 = decodeSymbol(&readers[2], table);
+		int symbol3 = decodeSymbol(&readers[3], table);
+		if((symbol0 | symbol1 | symbol2 | symbol3) < 0)
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return 1;
+		}
+		out0[j] = (unsigned char)symbol0;
+		out1[j] = (unsigned char)symbol1;
+		out2[j] = (unsigned char)symbol2;
+		out3[j] = (unsigned char)symbol3;
+	}
+
+	long remainder = decompressedOutLength - STREAM_COUNT*segmentLength;
+	return decodeString(&readers[3], &out3[segmentLength], remainder, table) 
+		!= remainder;
+}
+
+/*******************************************************************************
+ * This function starts a bit reader on each stream of a four stream payload 
+ * from its jump table.
+*******************************************************************************/
+int openStreams(const unsigned char *payload, long payloadLength, 
+	bit_reader_t readers[STREAM_COUNT])
+{
+	if(payloadLength < STREAM_JUMP_SIZE)
+	{
+		fprintf(stderr, "Compressed data is corrupt.\n");
+		return 1;
+	}
+
+	long streamStart = STREAM_JUMP_SIZE;
+	int k;
+	for(k=0; k<STREAM_COUNT; k++)
+	{
+		long streamLength = k < STREAM_COUNT - 1 ? 
+			(long)loadU32(&payload[4*k]) : payloadLength - streamStart;
+		if(streamLength > payloadLength - streamStart)
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return 1;
+		}
+		initBitReader(&readers[k], &payload[streamStart], streamLength);
+		streamStart += streamLength;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function decodes an order-1 bitstream, each symbol with the table 
+ * picked by the symbol before it, starting after the given previous byte.
+*******************************************************************************/
+long decodeOrder1String(bit_reader_t *reader, unsigned char *decompressedOut,
+	long decompressedOutLength, const decode_table_t *const tables[256], 
+	int previous)
+{
+	long j;
+	for(j=0; j<decompressedOutLength; j++)
+	{
+		int symbol = decodeSymbol(reader, tables[previous]);
+		if(symbol < 0)
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return -1;
+		}
+		decompressedOut[j] = (unsigned char)symbol;
+		previous = symbol;
+	}
+
+	return j;
+}
+
+/*******************************************************************************
+ * This function decodes an order-1 block payload. The four streams advance 
+ * in one loop as in decodeStreams, each from a zero previous byte.
+*******************************************************************************/
+int decodeOrder1Block(int blockFlags, const unsigned char *payload, 
+	long payloadLength, unsigned char *decompressedOut, long blockLength, 
+	const order1_tables_t *order1)
+{
+	const decode_table_t *tables[256];
+	int i;
+	for(i=0; i<256; i++)
+	{
+		tables[i] = &(*order1).decodeTables[(*order1).groups[i]];
+	}
+	if(!(blockFlags & BLOCK_FLAG_FOUR_STREAMS))
+	{
+		bit_reader_t reader;
+		initBitReader(&reader, payload, payloadLength);
+		return decodeOrder1String(&reader, decompressedOut, blockLength, 
+			tables, 0) != blockLength;
+	}
+
+	bit_reader_t readers[STREAM_COUNT];
+	if(openStreams(payload, payloadLength, readers))
+	{
+		return 1;
+	}
+	long segmentLength = blockLength/STREAM_COUNT;
+	unsigned char *out0 = decompressedOut;
+	unsigned char *out1 = &decompressedOut[segmentLength];
+	unsigned char *out2 = &decompressedOut[2*segmentLength];
+	unsigned char *out3 = &decompressedOut[3*segmentLength];
+	int symbol0 = 0;
+	int symbol1 = 0;
+	int symbol2 = 0;
+	int symbol3 = 0;
+	long j;
+	for(j=0; j<segmentLength; j++)
+	{
+		symbol0 = decodeSymbol(&readers[0], tables[symbol0]);
+		symbol1 = decodeSymbol(&readers[1], tables[symbol1]);
+		symbol2 = decodeSymbol(&readers[2], tables[symbol2]);
+		symbol3 = decodeSymbol(&readers[3], tables[symbol3]);
+		if((symbol0 | symbol1 | symbol2 | symbol3) < 0)
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return 1;
+		}
+		out0[j] = (unsigned char)symbol0;
+		out1[j] = (unsigned char)symbol1;
+		out2[j] = (unsigned char)symbol2;
+		out3[j] = (unsigned char)symbol3;
+	}
+
+	long remainder = blockLength - STREAM_COUNT*segmentLength;
+	return decodeOrder1String(&readers[3], &out3[segmentLength], remainder, 
+		tables, symbol3) != remainder;
+}
+
+/*******************************************************************************
+ * This function decodes the bytes from start up to end of a block into their
+ * place in the output buffer, leaving the rest of it as it was. The streams 
+ * of a four stream block code consecutive quarters of it, so the jump table 
+ * is a checkpoint into each quarter: streams outside the range are skipped 
+ * and each stream stops at the end of the range.
+*******************************************************************************/
+int decodeBlockRange(int blockFlags, const unsigned char *payload, 
+	long payloadLength, unsigned char *decompressedOut, long blockLength, 
+	const decode_table_t *table, const order1_tables_t *order1, long start, 
+	long end)
+{
+	if((start == 0 && end == blockLength) || 
+		(blockFlags & (BLOCK_FLAG_RAW | BLOCK_FLAG_FILL)))
+	{
+		return decodeBlock(blockFlags, payload, payloadLength, decompressedOut,
+			blockLength, table, order1);
+	}
+	const decode_table_t *tables[256];
+	int i;
+	for(i=0; i<256 && (blockFlags & BLOCK_FLAG_ORDER1); i++)
+	{
+		tables[i] = &(*order1).decodeTables[(*order1).groups[i]];
+	}
+	bit_reader_t readers[STREAM_COUNT];
+	int streamCount = 1;
+	long segmentLength = blockLength;
+	if(blockFlags & BLOCK_FLAG_FOUR_STREAMS)
+	{
+		if(openStreams(payload, payloadLength, readers))
+		{
+			return 1;
+		}
+		streamCount = STREAM_COUNT;
+		segmentLength = blockLength/STREAM_COUNT;
+	}
+	else
+	{
+		initBitReader(&readers[0], payload, payloadLength);
+	}
+
+	/****the last stream also codes the remainder of the block.****/
+	int k;
+	for(k=0; k<streamCount; k++)
+	{
+		long segmentStart = k*segmentLength;
+		long segmentEnd = k == streamCount - 1 ? blockLength : 
+			segmentStart + segmentLength;
+		if(segmentEnd <= start || segmentStart >= end)
+		{
+			continue;
+		}
+		long length = (segmentEnd < end ? segmentEnd : end) - segmentStart;
+		long decoded = (blockFlags & BLOCK_FLAG_ORDER1) ? 
+			decodeOrder1String(&readers[k], &decompressedOut[segmentStart], 
+			length, tables, 0) : decodeString(&readers[k], 
+			&decompressedOut[segmentStart], length, table);
+		if(decoded != length)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function decodes a block payload, single or four stream and with one 
+ * table or order-1 tables as its flags say, into the output buffer. Raw and 
+ * fill blocks are copied and filled.
+*******************************************************************************/
+int decodeBlock(int blockFlags, const unsigned char *payload, 
+	long payloadLength, unsigned char *decompressedOut, long blockLength, 
+	const decode_table_t *table, const order1_tables_t *order1)
+{
+	if(blockFlags & (BLOCK_FLAG_RAW | BLOCK_FLAG_FILL))
+	{
+		if(!storedBlockValid(blockFlags, payloadLength, blockLength))
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return 1;
+		}
+		if(blockFlags & BLOCK_FLAG_RAW)
+		{
+			memcpy(decompressedOut, payload, blockLength);
+		}
+		else
+		{
+			memset(decompressedOut, payload[0], blockLength);
+		}
+		return 0;
+	}
+	if(blockFlags & BLOCK_FLAG_ORDER1)
+	{
+		return decodeOrder1Block(blockFlags, payload, payloadLength, 
+			decompressedOut, blockLength, order1);
+	}
+	if(blockFlags & BLOCK_FLAG_FOUR_STREAMS)
+	{
+		return decodeStreams(payload, payloadLength, decompressedOut, 
+			blockLength, table);
+	}
+
+	bit_reader_t reader;
+	initBitReader(&reader, payload, payloadLength);
+	return decodeString(&reader, decompressedOut, blockLength, table) != 
+		blockLength;
+}
+
+/*******************************************************************************
+ * This function checks the flags and payload length of a raw or fill block, 
+ * which takes no other flag.
+*******************************************************************************/
+int storedBlockValid(int blockFlags, long payloadLength, long blockLength)
+{
+	if(blockFlags == BLOCK_FLAG_RAW)
+	{
+		return payloadLength == blockLength;
+	}
+	return blockFlags == BLOCK_FLAG_FILL && payloadLength == 1;
+}
+
+/*******************************************************************************
+ * This function decodes an adaptive block a segment at a time, adapting the 
+ * model and rebuilding the decode table at the same bytes as the encoder.
+*******************************************************************************/
+int decodeAdaptive(adaptive_model_t *model, decode_table_t *table, 
+	const unsigned char *payload, long payloadLength, 
+	unsigned char *decompressedOut, long blockLength)
+{
+	bit_reader_t reader;
+	initBitReader(&reader, payload, payloadLength);
+	long start = 0;
+	while(start < blockLength)
+	{
+		long length = blockLength - start < (*model).untilRebuild ? 
+			blockLength - start : (*model).untilRebuild;
+		if(decodeString(&reader, &decompressedOut[start], length, table) != 
+			length || adaptModel(model, &decompressedOut[start], length, table))
+		{
+			return 1;
+		}
+		start += length;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+ * This function decompresses the input file, - for stdin, into the output 
+ * file, - for stdout. Without an output name the file is only decoded and 
+ * checked.
 *******************************************************************************/
+int decompressFile(codec_context_t *context, const char *inputName, 
+	const char *outputName, const compress_options_t *options)
+{
+	input_source_t source;
+	if(openInputSource(&source, inputName))
+	{
+		return 1;
+	}
+	FILE *fpOut = NULL;
+	if(outputName != NULL)
+	{
+		fpOut = openOutput(outputName);
+		if(fpOut == NULL)
+		{
+			closeFiles(&source, NULL, NULL, 0);
+			return 1;
+		}
+	}
+
+	job_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	struct timespec start;
+	startTimer(&start);
+	int status = decompressSource(context, &source, fpOut, options, &stats);
+	status = closeFiles(&source, fpOut, outputName, status);
+	stats.seconds = secondsSince(&start);
+	if(!status && (*options).verbosity > 0 && fpOut != NULL && 
+		fpOut != stdout)
+	{
+		fprintf(stderr, " - written to %s\n", outputName);
+	}
+	if((*options).stats)
+	{
+		printStats(outputName == NULL ? "test" : "decompress", inputName, 
+			&stats, options, status);
+	}
 
-/*******************************************************************************
- * Header files
-*******************************************************************************/
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+	return status;
+}
 
 /*******************************************************************************
- * Structures
+ * This function tests a compressed file or every member of an archive, 
+ * decoding the blocks and checking their checksums without writing them.
 *******************************************************************************/
-struct node
+int testInput(codec_context_t *context, const char *inputName, 
+	const compress_options_t *options)
 {
-	int freq;
-	int charIndex;
-	struct node *largerFreq;
-	struct node *smallerFreq;
-};
-typedef struct node node_t;
+	unsigned char magic[FILE_MAGIC_SIZE];
+	int archive = 0;
+	FILE *fp = strcmp(inputName, "-") != 0 ? fopen(inputName, "rb") : NULL;
+	if(fp != NULL)
+	{
+		archive = fread(magic, sizeof(unsigned char), FILE_MAGIC_SIZE, fp) == 
+			FILE_MAGIC_SIZE && memcmp(magic, ARCHIVE_MAGIC, 
+			FILE_MAGIC_SIZE) == 0;
+		fclose(fp);
+	}
+	int status = archive ? 
+		extractArchive(context, inputName, NULL, 0, NULL, options) : 
+		decompressFile(context, inputName, NULL, options);
+	if(!status && (*options).verbosity > 0)
+	{
+		fprintf(stderr, "%s: OK\n", inputName);
+	}
 
-struct key_value_pair
-{
-	char uniqueChar;
-	char *hCode;
-};
-typedef struct key_value_pair key_value_pair_t;
+	return status;
+}
 
 /*******************************************************************************
- * Function prototypes
+ * This function decompresses a compressed file, or an archive member, from 
+ * its file header on. Blocks are decoded in parallel when the file has a 
+ * block index and the output is a regular file, or when there is no output 
+ * and the blocks are only checked.
 *******************************************************************************/
-int printMenu(void);
+int decompressSource(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, const compress_options_t *options, job_stats_t *stats)
+{
+	int flags = 0;
+	if(readFileHeader(source, options, &flags))
+	{
+		return 1;
+	}
+	if((flags & FILE_FLAG_BLOCK_INDEX) && (*options).threadCount > 1 && 
+		(*source).size >= 0 && (fpOut == NULL || (fpOut != stdout && 
+		isRegularFile(fpOut))))
+	{
+		return decompressIndexed(context, source, fpOut, flags, options, 
+			stats);
+	}
+	return decompressStream(context, source, fpOut, flags, options, NULL, 
+		stats);
+}
 
-int selectChoice(void);
+/*******************************************************************************
+ * This function decompresses a stream of blocks, following the file header, 
+ * writing each block out as soon as it is decoded. Without an output stream 
+ * the blocks are only decoded. Mapped payloads are decoded in place. Given a 
+ * range, only its bytes are written: blocks before it are read but not 
+ * decoded, except adaptive blocks which every later block depends on, and 
+ * the stream is left at the first block past it. Blocks decoded whole are 
+ * checked against their checksums when the file has them.
+*******************************************************************************/
+int decompressStream(codec_context_t *context, input_source_t *source, 
+	FILE *fpOut, int flags, const compress_options_t *options, 
+	const byte_range_t *range, job_stats_t *stats)
+{
+	unsigned char headerBuffer[BLOCK_HEADER_SIZE];
+	const unsigned char *header;
+	const unsigned char *payload;
+	decode_table_t *decodeTable = &(*context).decodeTable;
+	int hasTable = 0;
+	symbol_code_t codeTable[256];
+	adaptive_model_t model;
+	int adaptive = -1; /*set by the first block, streams do not mix modes*/
+	long blockCount = 0;
+	int64_t totalOut = 0;
+	int status = 0;
+	int timed = (*options).stats;
+	struct timespec clock;
+	if(timed)
+	{
+		startTimer(&clock);
+	}
 
-int compressFile(void);
+	while(!status)
+	{
+		if(readInput(source, headerBuffer, BLOCK_HEADER_SIZE, &header) != 
+			BLOCK_HEADER_SIZE)
+		{
+			fprintf(stderr, "Compressed data is truncated.\n");
+			status = 1;
+			break;
+		}
+		if(timed)
+		{
+			lapTimer(&clock, &(*stats).times.read);
+		}
+		long blockLength = (long)loadU32(&header[1]);
+		long payloadLength = (long)loadU32(&header[5]);
+		if(blockLength == 0 || (range != NULL && 
+			(uint64_t)totalOut >= (*range).end))
+		{
+			break;
+		}
+		int order1 = (header[0] & BLOCK_FLAG_ORDER1) != 0;
+		int stored = (header[0] & (BLOCK_FLAG_RAW | BLOCK_FLAG_FILL)) != 0;
+		if(blockLength > MAX_BLOCK_SIZE || payloadLength > MAX_BLOCK_SIZE || 
+			(adaptive >= 0 && adaptive != !!(header[0] & BLOCK_FLAG_ADAPTIVE)) 
+			|| (order1 && (header[0] & (BLOCK_FLAG_ADAPTIVE | 
+			BLOCK_FLAG_REUSE_TABLE | BLOCK_FLAG_DICTIONARY))) || (stored && 
+			!storedBlockValid(header[0], payloadLength, blockLength)))
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			status = 1;
+			break;
+		}
 
-int getInputString(char *fileName, char *charArray);
+		/****read the block's table, keep the previous or trained one, or 
+		adapt. Raw and fill blocks have none.****/
+		int trained = (header[0] & BLOCK_FLAG_DICTIONARY) != 0;
+		if(trained && (*options).dictionary == NULL)
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			status = 1;
+			break;
+		}
+		if(adaptive < 0)
+		{
+			adaptive = !!(header[0] & BLOCK_FLAG_ADAPTIVE);
+			if(adaptive && initAdaptiveModel(&model, decodeTable))
+			{
+				status = 1;
+				break;
+			}
+		}
+		if(stored || trained || 
+			(!adaptive && (header[0] & BLOCK_FLAG_REUSE_TABLE)))
+		{
+			if(!hasTable && !trained && !stored)
+			{
+				fprintf(stderr, "Compressed data is corrupt.\n");
+				status = 1;
+				break;
+			}
+		}
+		else if(order1)
+		{
+			if(readOrder1Tables(source, &(*context).order1))
+			{
+				status = 1;
+				break;
+			}
+			if(timed)
+			{
+				lapTimer(&clock, &(*stats).times.codes);
+			}
+			int g;
+			for(g=0; g<(*context).order1.groupCount; g++)
+			{
+				addTableStats(stats, (*context).order1.codeTables[g]);
+				if((*options).verbosity > 1)
+				{
+					fprintf(stderr, "block %ld group %d huffman codes:\n", 
+						blockCount, g);
+					printHuffmanCodes((*context).order1.codeTables[g]);
+				}
+			}
+		}
+		else if(!adaptive)
+		{
+			if(readBlockTable(source, decodeTable, codeTable))
+			{
+				status = 1;
+				break;
+			}
+			hasTable = 1;
+			if(timed)
+			{
+				lapTimer(&clock, &(*stats).times.codes);
+			}
+			addTableStats(stats, codeTable);
+			if((*options).verbosity > 1)
+			{
+				fprintf(stderr, "block %ld huffman codes:\n", blockCount);
+				printHuffmanCodes(codeTable);
+			}
+		}
 
-int uniqueCharsFreqCounter(char *inputString, int inputStringLength, 
-	char *uniqueChars, int *charFreq);
+		/****grow the buffers to the largest block seen.****/
+		if(((*source).map == NULL && reserveBuffer(&(*context).payloads, 
+			&(*context).payloadsCapacity, payloadLength)) || 
+			reserveBuffer(&(*context).outputs, &(*context).outputsCapacity, 
+			blockLength))
+		{
+			fprintf(stderr, "Cannot decompress file. Memory allocation "
+				"error.\n");
+			status = 1;
+			break;
+		}
+		unsigned char *decompressedOut = (*context).outputs;
 
-void createHuffmanTree(node_t *nodeArray[], const int noOfUniqueChars);
+		/****the part of the block within the range.****/
+		long start = 0;
+		long end = blockLength;
+		if(range != NULL)
+		{
+			uint64_t blockStart = (uint64_t)totalOut;
+			if((*range).start > blockStart)
+			{
+				start = (*range).start - blockStart < (uint64_t)blockLength ? 
+					(long)((*range).start - blockStart) : blockLength;
+			}
+			if((*range).end - blockStart < (uint64_t)blockLength)
+			{
+				end = (long)((*range).end - blockStart);
+			}
+		}
 
-int nextSmallestIndex(node_t *array[], int currentSmallestIndex, 
-	const int noOfUniqueChars);
+		/****decode the payload and write the block out.****/
+		if(readInput(source, (*context).payloads, payloadLength, &payload) != 
+			payloadLength)
+		{
+			fprintf(stderr, "Compressed data is truncated.\n");
+			status = 1;
+			break;
+		}
+		if(timed)
+		{
+			lapTimer(&clock, &(*stats).times.read);
+		}
+		if(adaptive ? decodeAdaptive(&model, decodeTable, payload, 
+			payloadLength, decompressedOut, blockLength) : start < end && 
+			decodeBlockRange(header[0], payload, payloadLength, 
+			decompressedOut, blockLength, trained ? 
+			&(*(*options).dictionary).decodeTable : decodeTable, 
+			&(*context).order1, start, end))
+		{
+			status = 1;
+			break;
+		}
 
-void preorderGenerationOfHuffmanCode(node_t *tree, int huffmanCode[], 
-	int codeIndex, const int noOfUniqueChars, key_value_pair_t *codeArray[]);
+		/****check a block decoded whole against its checksum.****/
+		if(flags & FILE_FLAG_CHECKSUMS)
+		{
+			const unsigned char *checksum;
+			if(readInput(source, headerBuffer, CHECKSUM_SIZE, &checksum) != 
+				CHECKSUM_SIZE)
+			{
+				fprintf(stderr, "Compressed data is truncated.\n");
+				status = 1;
+				break;
+			}
+			if((adaptive || (start == 0 && end == blockLength)) && 
+				crc32c(0, decompressedOut, blockLength) != loadU32(checksum))
+			{
+				fprintf(stderr, "Block %ld checksum does not match, the file "
+					"is corrupt.\n", blockCount);
+				status = 1;
+				break;
+			}
+		}
+		if(timed)
+		{
+			lapTimer(&clock, &(*stats).times.decode);
+		}
 
-int encodeString(char *inputString, int inputStringLength, char *compressedOut, 
-	const int noOfUniqueChars, key_value_pair_t *codeArray[]);
+		/*adaptive blocks are passed on at once, as they were written.*/
+		if(fpOut != NULL && start < end && (fwrite(&decompressedOut[start], 
+			sizeof(unsigned char), end - start, fpOut) != 
+			(size_t)(end - start) || (adaptive && fflush(fpOut) != 0)))
+		{
+			fprintf(stderr, "Cannot write output file.\n");
+			status = 1;
+			break;
+		}
+		if(timed)
+		{
+			lapTimer(&clock, &(*stats).times.write);
+		}
+		blockCount++;
+		totalOut += blockLength;
+	}
+	(*stats).bytesIn = (*source).size >= 0 ? (*source).size : 
+		(*source).position;
+	(*stats).bytesOut = totalOut;
+	(*stats).blocks = blockCount;
 
-int decodeString(char *compressedIn, int compressedInLength, 
-	char *decompressedOut, const int noOfUniqueChars, 
-	key_value_pair_t *codeArray[]);
+	return status;
+}
 
-int outputCompressedString(char *compressedString, int compressedStringLength, 
-	char *outputFileName);
+/*******************************************************************************
+ * This function writes the bytes of a range of the original of a compressed 
+ * file to the output file, - for stdout. A range past the end of the file is
+ * cut short. The block index finds the blocks the range lies in, so the work
+ * grows with the range rather than the file. Files without an index, a single
+ * block, adaptive or read from stdin, are decoded up to the end of the range.
+*******************************************************************************/
+int decompressRange(codec_context_t *context, const char *inputName, 
+	const char *outputName, const byte_range_t *range, 
+	const compress_options_t *options)
+{
+	input_source_t source;
+	if(openInputSource(&source, inputName))
+	{
+		return 1;
+	}
+	FILE *fpOut = openOutput(outputName);
+	if(fpOut == NULL)
+	{
+		closeFiles(&source, NULL, NULL, 0);
+		return 1;
+	}
 
-int outputCodes(key_value_pair_t *codeArray[], const int noOfUniqueChars, 
-	const int stringLength, char *outputFileName);
+	job_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	struct timespec start;
+	startTimer(&start);
+	int flags = 0;
+	int status = readFileHeader(&source, options, &flags);
+	if(!status)
+	{
+		status = (flags & FILE_FLAG_BLOCK_INDEX) && source.size >= 0 ? 
+			decompressIndexedRange(context, &source, fpOut, flags, range, 
+			options, &stats) : decompressStream(context, &source, fpOut, 
+			flags, options, range, &stats);
+	}
+	status = closeFiles(&source, fpOut, outputName, status);
+	stats.seconds = secondsSince(&start);
+	if(!status && (*options).verbosity > 0 && fpOut != stdout)
+	{
+		fprintf(stderr, " - written to %s\n", outputName);
+	}
+	if((*options).stats)
+	{
+		printStats("range", inputName, &stats, options, status);
+	}
 
-int decompressFile(void);
+	return status;
+}
 
-int generateCompressedFileName(char *inputFileName, int inputFileNameLength, 
-	char *compressedFileName);
+/*******************************************************************************
+ * This function writes a range of an indexed file. The pool decodes the 
+ * blocks the range covers in batches, each block only as far as the range 
+ * needs, and the parts in the range are written in order.
+*******************************************************************************/
+int decompressIndexedRange(codec_context_t *context, 
+	const input_source_t *source, FILE *fpOut, int flags, 
+	const byte_range_t *range, const compress_options_t *options, 
+	job_stats_t *stats)
+{
+	long blockCount;
+	if(readBlockIndex(context, source, &blockCount))
+	{
+		return 1;
+	}
+	const index_entry_t *entries = (*context).entries;
+	if(reserveBuffer(&(*context).outputOffsets, 
+		&(*context).outputOffsetsCapacity, sizeof(uint64_t)*(blockCount + 1)))
+	{
+		fprintf(stderr, "Cannot decompress file. Memory allocation error.\n");
+		return 1;
+	}
 
-int generateCodeFileName(char *compressedFileName, int compressedFileNameLength, 
-	char *codeFileName);
+	/****find the blocks from first up to last which hold the range.****/
+	uint64_t *outputOffsets = (*context).outputOffsets;
+	long first = blockCount;
+	long last = blockCount;
+	long maxBlockLength = 1;
+	long maxPayloadLength = 1;
+	outputOffsets[0] = 0;
+	long i;
+	for(i=0; i<blockCount; i++)
+	{
+		outputOffsets[i + 1] = outputOffsets[i] + entries[i].blockLength;
+		if(first == blockCount && outputOffsets[i + 1] > (*range).start && 
+			(*range).start < (*range).end)
+		{
+			first = i;
+		}
+		if(first < blockCount && last == blockCount && 
+			outputOffsets[i] >= (*range).end)
+		{
+			last = i;
+		}
+		if(first <= i && i < last)
+		{
+			if((long)entries[i].blockLength > maxBlockLength)
+			{
+				maxBlockLength = entries[i].blockLength;
+			}
+			if(((long)entries[i].payloadBits + 7)/8 > maxPayloadLength)
+			{
+				maxPayloadLength = ((long)entries[i].payloadBits + 7)/8;
+			}
+		}
+	}
 
-int generateDecompressedFileName(char *compressedFileName, 
-	int compressedFileNameLength, char *decompressedFileName);
+	int batchSize = (*options).threadCount*BLOCKS_PER_THREAD;
+	if(reserveBuffer(&(*context).decodeJobs, &(*context).decodeJobsCapacity, 
+		sizeof(decode_job_t)*batchSize) || ((*source).map == NULL && 
+		reserveBuffer(&(*context).payloads, &(*context).payloadsCapacity, 
+		maxPayloadLength*batchSize)) || reserveBuffer(&(*context).outputs, 
+		&(*context).outputsCapacity, maxBlockLength*batchSize))
+	{
+		fprintf(stderr, "Cannot decompress file. Memory allocation error.\n");
+		return 1;
+	}
+	if(reserveWorkerPool(context, (*options).threadCount))
+	{
+		return 1;
+	}
+	decode_job_t *jobs = (*context).decodeJobs;
+	int j;
+	for(j=0; j<batchSize; j++)
+	{
+		jobs[j].payload = (*source).map == NULL ? 
+			&(*context).payloads[maxPayloadLength*j] : NULL;
+		jobs[j].decompressedOut = &(*context).outputs[maxBlockLength*j];
+	}
 
-int inputCompressedFileToBinString(char *compressedFileName, 
-	char *compressedInputInBin);
+	decompress_batch_t batch;
+	batch.jobs = jobs;
+	batch.entries = entries;
+	batch.outputOffsets = outputOffsets;
+	batch.blockCount = blockCount;
+	batch.maxPayloadLength = maxPayloadLength;
+	batch.source = source;
+	batch.outFd = -1;
+	batch.range = range;
+	batch.checksums = (flags & FILE_FLAG_CHECKSUMS) != 0;
+	batch.dictionary = (*options).dictionary;
+	batch.timed = (*options).stats;
+	int status = 0;
+	int64_t totalOut = 0;
+	long block;
+	for(block=first; block<last && !status; block+=batchSize)
+	{
+		int jobCount = last - block < batchSize ? (int)(last - block) : 
+			batchSize;
+		for(j=0; j<jobCount; j++)
+		{
+			jobs[j].blockIndex = block + j;
+		}
+		runWorkerPool(&(*context).pool, decodeIndexedBlockTask, &batch, 
+			jobCount);
+		for(j=0; j<jobCount && !status; j++)
+		{
+			status = jobs[j].status;
+			addStageTimes(&(*stats).times, &jobs[j].times);
+			uint64_t blockStart = outputOffsets[block + j];
+			uint64_t start = (*range).start > blockStart ? (*range).start : 
+				blockStart;
+			uint64_t end = (*range).end < outputOffsets[block + j + 1] ? 
+				(*range).end : outputOffsets[block + j + 1];
+			size_t length = (size_t)(end - start);
+			if(!status && fwrite(&jobs[j].decompressedOut[start - blockStart],
+				sizeof(unsigned char), length, fpOut) != length)
+			{
+				fprintf(stderr, "Cannot write output file.\n");
+				status = 1;
+			}
+			totalOut += (int64_t)length;
+		}
+	}
+	(*stats).bytesIn = (*source).size;
+	(*stats).bytesOut = totalOut;
+	(*stats).blocks = last - first;
 
-char reverseBitsInByte(char byte);
+	return status;
+}
 
 /*******************************************************************************
- * Main
+ * This function writes the block index and the footer locating it.
 *******************************************************************************/
-int main(void)
+int writeBlockIndex(FILE *fpOut, const index_entry_t *entries, 
+	long blockCount, uint64_t indexOffset)
 {
-	printf("\n-----------------Huffman Compression-----------------\n");
-	
-	while(1)
+	/*the footer holds a 32 bit block count.*/
+	if((uint64_t)blockCount > UINT32_MAX)
 	{
-		printMenu();
-		int i = selectChoice();
-		if(i == 3)
+		fprintf(stderr, "Too many blocks to index, use larger blocks.\n");
+		return 1;
+	}
+	unsigned char entry[INDEX_ENTRY_SIZE];
+	long i;
+	for(i=0; i<blockCount; i++)
+	{
+		storeU64(entry, entries[i].offset);
+		storeU32(&entry[8], entries[i].payloadBits);
+		storeU32(&entry[12], entries[i].blockLength);
+		storeU32(&entry[16], entries[i].tableBlock);
+		if(fwrite(entry, sizeof(unsigned char), INDEX_ENTRY_SIZE, fpOut) != 
+			INDEX_ENTRY_SIZE)
 		{
-			return 0;
+			fprintf(stderr, "output file cannot be written.\n");
+			return 1;
 		}
 	}
-	
+
+	unsigned char footer[INDEX_FOOTER_SIZE];
+	storeU64(footer, indexOffset);
+	storeU32(&footer[8], (uint32_t)blockCount);
+	memcpy(&footer[12], INDEX_MAGIC, FILE_MAGIC_SIZE);
+	if(fwrite(footer, sizeof(unsigned char), INDEX_FOOTER_SIZE, fpOut) != 
+		INDEX_FOOTER_SIZE)
+	{
+		fprintf(stderr, "output file cannot be written.\n");
+		return 1;
+	}
+
 	return 0;
 }
 
 /*******************************************************************************
- * This function prints user menu.
+ * This function decompresses a file through its block index. The output is 
+ * sized up front and the worker pool decodes the blocks in parallel, each 
+ * thread reading its block from the map or with pread and writing the result 
+ * with pwrite at the block's offset in the output. Without an output the 
+ * blocks are only decoded and checked.
 *******************************************************************************/
-int printMenu(void)
+int decompressIndexed(codec_context_t *context, const input_source_t *source,
+	FILE *fpOut, int flags, const compress_options_t *options, 
+	job_stats_t *stats)
 {
-	printf("\n1. Compress file.\n");
-	printf("2. Decompress file.\n");
-	printf("3. Exit.\n\n");
-	printf("Enter an option between 1-3:\n");
+	long blockCount;
+	if(readBlockIndex(context, source, &blockCount))
+	{
+		return 1;
+	}
+	const index_entry_t *entries = (*context).entries;
 
-	return 0;
+	/****the output offset of a block is the total length before it.****/
+	if(reserveBuffer(&(*context).outputOffsets, 
+		&(*context).outputOffsetsCapacity, sizeof(uint64_t)*(blockCount + 1)))
+	{
+		fprintf(stderr, "Cannot decompress file. Memory allocation error.\n");
+		return 1;
+	}
+	uint64_t *outputOffsets = (*context).outputOffsets;
+	long maxBlockLength = 1;
+	long maxPayloadLength = 1;
+	outputOffsets[0] = 0;
+	long i;
+	for(i=0; i<blockCount; i++)
+	{
+		outputOffsets[i + 1] = outputOffsets[i] + entries[i].blockLength;
+		if((long)entries[i].blockLength > maxBlockLength)
+		{
+			maxBlockLength = entries[i].blockLength;
+		}
+		if(((long)entries[i].payloadBits + 7)/8 > maxPayloadLength)
+		{
+			maxPayloadLength = ((long)entries[i].payloadBits + 7)/8;
+		}
+	}
+	if(fpOut != NULL && 
+		ftruncate(fileno(fpOut), (off_t)outputOffsets[blockCount]) != 0)
+	{
+		fprintf(stderr, "Cannot write output file.\n");
+		return 1;
+	}
+
+	/****decode batches of blocks across the pool.****/
+	int batchSize = (*options).threadCount*BLOCKS_PER_THREAD;
+	if(reserveBuffer(&(*context).decodeJobs, &(*context).decodeJobsCapacity, 
+		sizeof(decode_job_t)*batchSize) || ((*source).map == NULL && 
+		reserveBuffer(&(*context).payloads, &(*context).payloadsCapacity, 
+		maxPayloadLength*batchSize)) || reserveBuffer(&(*context).outputs, 
+		&(*context).outputsCapacity, maxBlockLength*batchSize))
+	{
+		fprintf(stderr, "Cannot decompress file. Memory allocation error.\n");
+		return 1;
+	}
+	int status = reserveWorkerPool(context, (*options).threadCount);
+	decode_job_t *jobs = (*context).decodeJobs;
+	int j;
+	for(j=0; j<batchSize; j++)
+	{
+		jobs[j].payload = (*source).map == NULL ? 
+			&(*context).payloads[maxPayloadLength*j] : NULL;
+		jobs[j].decompressedOut = &(*context).outputs[maxBlockLength*j];
+	}
+
+	if(!status)
+	{
+		decompress_batch_t batch;
+		batch.jobs = jobs;
+		batch.entries = entries;
+		batch.outputOffsets = outputOffsets;
+		batch.blockCount = blockCount;
+		batch.maxPayloadLength = maxPayloadLength;
+		batch.source = source;
+		batch.outFd = fpOut != NULL ? fileno(fpOut) : -1;
+		batch.range = NULL;
+		batch.checksums = (flags & FILE_FLAG_CHECKSUMS) != 0;
+		batch.dictionary = (*options).dictionary;
+		batch.timed = (*options).stats;
+		long first;
+		for(first=0; first<blockCount && !status; first+=batchSize)
+		{
+			int jobCount = blockCount - first < batchSize ? 
+				(int)(blockCount - first) : batchSize;
+			for(j=0; j<jobCount; j++)
+			{
+				jobs[j].blockIndex = first + j;
+			}
+			runWorkerPool(&(*context).pool, decodeIndexedBlockTask, &batch, 
+				jobCount);
+			for(j=0; j<jobCount; j++)
+			{
+				status |= jobs[j].status;
+				addStageTimes(&(*stats).times, &jobs[j].times);
+				int g;
+				for(g=0; g<jobs[j].order1.groupCount; g++)
+				{
+					addTableStats(stats, jobs[j].order1.codeTables[g]);
+				}
+				if(jobs[j].ownTable)
+				{
+					addTableStats(stats, jobs[j].codeTable);
+				}
+			}
+		}
+		(*stats).bytesIn = (*source).size;
+		(*stats).bytesOut = (int64_t)outputOffsets[blockCount];
+		(*stats).blocks = blockCount;
+		if((*options).verbosity > 0)
+		{
+			fprintf(stderr, " - %ld blocks decoded on %d threads\n", 
+				blockCount, (*options).threadCount);
+		}
+	}
+
+	return status;
 }
 
 /*******************************************************************************
- * This function takes the user selection using switch case.
+ * This function reads and checks the block index from the end of the file.
 *******************************************************************************/
-int selectChoice(void)
+int readBlockIndex(codec_context_t *context, const input_source_t *source, 
+	long *blockCount)
 {
-	char input[200];
-	fgets(input, sizeof(input), stdin);
-	char choice = '0';
-	if(strlen(input) == 2)
+	unsigned char footerBuffer[INDEX_FOOTER_SIZE];
+	const unsigned char *footer;
+	int64_t footerOffset = (*source).size - INDEX_FOOTER_SIZE;
+	if(footerOffset < FILE_HEADER_SIZE || readInputAt(source, footerBuffer, 
+		INDEX_FOOTER_SIZE, (uint64_t)footerOffset, &footer) != 
+		INDEX_FOOTER_SIZE || memcmp(&footer[12], INDEX_MAGIC, 
+		FILE_MAGIC_SIZE) != 0)
 	{
-		choice  = input[0];
+		fprintf(stderr, "Block index is missing.\n");
+		return 1;
+	}
+	uint64_t indexOffset = loadU64(footer);
+	*blockCount = (long)loadU32(&footer[8]);
+	if(indexOffset + (uint64_t)*blockCount*INDEX_ENTRY_SIZE != 
+		(uint64_t)footerOffset)
+	{
+		fprintf(stderr, "Block index is corrupt.\n");
+		return 1;
+	}
+
+	if(reserveBuffer(&(*context).entries, &(*context).entriesCapacity, 
+		sizeof(index_entry_t)*(*blockCount + 1)))
+	{
+		fprintf(stderr, "Cannot read block index. Memory allocation error.\n");
+		return 1;
 	}
-	switch(choice)
+	index_entry_t *entries = (*context).entries;
+	unsigned char entryBuffer[INDEX_ENTRY_SIZE];
+	const unsigned char *entry;
+	long i;
+	for(i=0; i<*blockCount; i++)
 	{
-		case '1':	compressFile();
-				 	break;
-		case '2':	decompressFile();
-					break;
-		case '3':	return 3;
+		if(readInputAt(source, entryBuffer, INDEX_ENTRY_SIZE, 
+			indexOffset + (uint64_t)i*INDEX_ENTRY_SIZE, &entry) != 
+			INDEX_ENTRY_SIZE)
+		{
+			fprintf(stderr, "Block index is truncated.\n");
+			return 1;
+		}
+		entries[i].offset = loadU64(entry);
+		entries[i].payloadBits = loadU32(&entry[8]);
+		entries[i].blockLength = loadU32(&entry[12]);
+		entries[i].tableBlock = loadU32(&entry[16]);
 
-		default :printf("Invalid option.\n");
+		/*blocks are in file order and tables only come from earlier blocks.*/
+		if(entries[i].offset < FILE_HEADER_SIZE || 
+			entries[i].offset >= indexOffset || 
+			(i > 0 && entries[i].offset <= entries[i - 1].offset) || 
+			entries[i].blockLength == 0 || 
+			entries[i].blockLength > MAX_BLOCK_SIZE || 
+			entries[i].payloadBits > 8*(uint64_t)MAX_BLOCK_SIZE || 
+			entries[i].tableBlock > (uint32_t)i)
+		{
+			fprintf(stderr, "Block index is corrupt.\n");
+			return 1;
+		}
 	}
 
 	return 0;
 }
 
 /*******************************************************************************
- * This function uses huffam code to compress user selected file.
+ * This function is the pool task decoding one block of an indexed file.
 *******************************************************************************/
-int compressFile(void)
+void decodeIndexedBlockTask(void *context, int index)
 {
+	decompress_batch_t *batch = context;
+	decode_job_t *job = &(*batch).jobs[index];
 
-	printf("Enter the name of the file you wish to compress: \n");
-	char inputFileName[100];
-	fgets(inputFileName, sizeof(inputFileName), stdin);
-	inputFileName[strlen(inputFileName)-1] = '\0'; /*clear \n from input*/
-
+	memset(&(*job).times, 0, sizeof(stage_times_t));
+	(*job).status = decodeIndexedBlock(batch, job);
+}
 
-	/****store contents from input file to char array.****/
-	char *string = malloc(sizeof(char)*2000000);
-	if(string == NULL)
+/*******************************************************************************
+ * This function decodes one block of an indexed file and writes it at its 
+ * output offset. A block reusing a table reads it from the block named by the
+ * index. A block decoded whole is checked against its checksum, which follows
+ * its payload, when the file has them.
+*******************************************************************************/
+int decodeIndexedBlock(decompress_batch_t *batch, decode_job_t *job)
+{
+	const index_entry_t *entry = &(*batch).entries[(*job).blockIndex];
+	(*job).order1.groupCount = 0;
+	(*job).ownTable = 0;
+	struct timespec clock;
+	if((*batch).timed)
+	{
+		startTimer(&clock);
+	}
+	unsigned char headerBuffer[BLOCK_HEADER_SIZE];
+	const unsigned char *header;
+	if(readInputAt((*batch).source, headerBuffer, BLOCK_HEADER_SIZE, 
+		(*entry).offset, &header) != BLOCK_HEADER_SIZE)
 	{
-		fprintf(stderr, "Cannot open file. Memory allocation error.");
+		fprintf(stderr, "Compressed data is truncated.\n");
 		return 1;
 	}
-	int stringLength = getInputString(inputFileName, string);
-	if(stringLength == -1)
+	long blockLength = (long)loadU32(&header[1]);
+	long payloadLength = (long)loadU32(&header[5]);
+	int ownTable = !(header[0] & BLOCK_FLAG_REUSE_TABLE);
+	if(blockLength != (long)(*entry).blockLength || 
+		payloadLength != ((long)(*entry).payloadBits + 7)/8 || 
+		ownTable != ((*entry).tableBlock == (uint32_t)(*job).blockIndex))
 	{
+		fprintf(stderr, "Block index does not match block %ld.\n", 
+			(*job).blockIndex);
 		return 1;
 	}
 
-
-	/****store the unique chars and corresponding frequencies in arrays****/
-	char *uniqueChars = malloc(sizeof(char)*stringLength);
-	*uniqueChars = '\0';
-	int *charFreq = malloc(sizeof(int)*stringLength);
-
-	const int noOfUniqueChars = uniqueCharsFreqCounter(string, stringLength, 
-		uniqueChars, charFreq);
-
-	/*printf(" - %d unique characters\n", noOfUniqueChars);*/
-
-
-	/**initialise nodeArray to store a node_t variable for each unique char.***/
-	node_t *nodeArray[noOfUniqueChars];
-	int i;
-	for(i=0;i<noOfUniqueChars;i++){
-		nodeArray[i] = malloc(sizeof(node_t));
-		(*nodeArray[i]).freq = charFreq[i];
-		(*nodeArray[i]).charIndex = i;
-		(*nodeArray[i]).largerFreq = NULL;
-		(*nodeArray[i]).smallerFreq = NULL;
+	/****a trained block's table is already built, raw and fill blocks 
+	need none.****/
+	const decode_table_t *table = &(*job).decodeTable;
+	long tableSize = 0;
+	if(header[0] & (BLOCK_FLAG_RAW | BLOCK_FLAG_FILL))
+	{
+		table = NULL;
 	}
-
-
-	/****initialise codeArray to store a key_value_pair_t variable storing the 
-	index and huffman code for each unique char.****/
-	key_value_pair_t *codeArray[noOfUniqueChars];
-	int ii;
-	for(ii=0;ii<noOfUniqueChars;ii++)
+	else if(header[0] & BLOCK_FLAG_DICTIONARY)
 	{
-		codeArray[ii] = malloc(sizeof(key_value_pair_t));
-		(*codeArray[ii]).uniqueChar = uniqueChars[ii];
-		(*codeArray[ii]).hCode = NULL;
+		if((*batch).dictionary == NULL)
+		{
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return 1;
+		}
+		table = &(*(*batch).dictionary).decodeTable;
+		memcpy((*job).codeTable, (*(*batch).dictionary).codeTable, 
+			sizeof(symbol_code_t)*256);
+	}
+	else if(header[0] & BLOCK_FLAG_ORDER1)
+	{
+		tableSize = readIndexedOrder1Tables((*batch).source, (*entry).offset, 
+			&(*job).order1);
+	}
+	else
+	{
+		tableSize = readIndexedTable((*batch).source, 
+			(*batch).entries[(*entry).tableBlock].offset, &(*job).decodeTable, 
+			(*job).codeTable);
+		(*job).ownTable = ownTable;
+	}
+	if(tableSize < 0)
+	{
+		return 1;
+	}
+	if((*batch).timed)
+	{
+		lapTimer(&clock, &(*job).times.codes);
 	}
 
-
-	/****create huffman tree****/
-	createHuffmanTree(nodeArray, noOfUniqueChars);
-
-
-	/****create huffman codes from binary tree using preorder algorithim.****/
-	/*prepare variables for preorder function.*/
-	int codeIndex = 0;
-	int huffmanCode[noOfUniqueChars];
-	int indexOfTreeTop;
-	int k;
-	for(k=0;k<noOfUniqueChars;k++)
+	/****a range decodes only its part of the block.****/
+	long start = 0;
+	long end = blockLength;
+	if((*batch).range != NULL)
 	{
-		if((*nodeArray[k]).freq != -1){
-			indexOfTreeTop = k;
+		uint64_t blockStart = (*batch).outputOffsets[(*job).blockIndex];
+		if((*(*batch).range).start > blockStart)
+		{
+			start = (long)((*(*batch).range).start - blockStart);
+		}
+		if((*(*batch).range).end - blockStart < (uint64_t)blockLength)
+		{
+			end = (long)((*(*batch).range).end - blockStart);
 		}
 	}
-	/*generates and stores huffman codes as key-value pairs in pairArray*/
-	printf("\n>Generating Huffman Codes\n...\n");
-	preorderGenerationOfHuffmanCode(nodeArray[indexOfTreeTop], huffmanCode, 
-		codeIndex, noOfUniqueChars, codeArray);
-	
-	/*print huffman codes*/
-	int l;
-	for(l=0;l<noOfUniqueChars;l++)
+	uint64_t payloadOffset = (*entry).offset + BLOCK_HEADER_SIZE + 
+		(ownTable ? tableSize : 0);
+	const unsigned char *payload;
+	int status = 0;
+	if(readInputAt((*batch).source, (*job).payload, payloadLength, 
+		payloadOffset, &payload) != payloadLength)
 	{
-		printf("c: %c, code: %s\n", (*codeArray[l]).uniqueChar, 
-			(*codeArray[l]).hCode);
+		fprintf(stderr, "Compressed data is truncated.\n");
+		status = 1;
 	}
-	
-
-	/****compress input string with created values****/
-	printf("\n>Compressing %s\n...\n", inputFileName);
-	int maxLengthOfHCode = noOfUniqueChars - 1;/*max possible len of code*/
-	char *compressedOut = malloc(sizeof(char)*maxLengthOfHCode*stringLength);
-	*compressedOut = '\0';
-	int compressedOutLength = encodeString(string, stringLength, compressedOut, 
-		noOfUniqueChars, codeArray);
-
-
-	/****output compressed string into txt file****/
-	char *compressedFileName = malloc((sizeof(char)*strlen(inputFileName))+11);
-	generateCompressedFileName(inputFileName, strlen(inputFileName), 
-		compressedFileName);
-	if(!outputCompressedString(compressedOut, compressedOutLength, 
-		compressedFileName))
+	else
 	{
-		printf("Compressed file written as %s\n", compressedFileName);
+		if((*batch).timed)
+		{
+			lapTimer(&clock, &(*job).times.read);
+		}
+		if(decodeBlockRange(header[0], payload, payloadLength, 
+			(*job).decompressedOut, blockLength, table, &(*job).order1, start,
+			end) || ((*batch).checksums && start == 0 && end == blockLength && 
+			checkIndexedBlock(batch, job, payloadOffset + payloadLength, 
+			blockLength)))
+		{
+			status = 1;
+		}
+		else
+		{
+			if((*batch).timed)
+			{
+				lapTimer(&clock, &(*job).times.decode);
+			}
+			if((*batch).outFd >= 0 && pwrite((*batch).outFd, 
+				(*job).decompressedOut, blockLength, 
+				(off_t)(*batch).outputOffsets[(*job).blockIndex]) != 
+				blockLength)
+			{
+				fprintf(stderr, "Cannot write output file.\n");
+				status = 1;
+			}
+			if((*batch).timed)
+			{
+				lapTimer(&clock, &(*job).times.write);
+			}
+		}
 	}
 
+	return status;
+}
 
-	/****output code Array, noOfUniqueChars and original string length.****/
-	char *compressedCodeFileName=malloc(sizeof(char)*(strlen(compressedFileName)
-										+6));
-	generateCodeFileName(compressedFileName, strlen(compressedFileName), 
-		compressedCodeFileName);
-	if(!outputCodes(codeArray, noOfUniqueChars, stringLength, 
-		compressedCodeFileName))
+/*******************************************************************************
+ * This function compares the checksum at the given offset with the checksum 
+ * of a decoded block.
+*******************************************************************************/
+int checkIndexedBlock(const decompress_batch_t *batch, const decode_job_t *job,
+	uint64_t offset, long blockLength)
+{
+	unsigned char checksumBuffer[CHECKSUM_SIZE];
+	const unsigned char *checksum;
+	if(readInputAt((*batch).source, checksumBuffer, CHECKSUM_SIZE, offset, 
+		&checksum) != CHECKSUM_SIZE)
 	{
-		printf("Dependent huffman codes file written as %s\n", 
-			compressedCodeFileName);
+		fprintf(stderr, "Compressed data is truncated.\n");
+		return 1;
+	}
+	if(crc32c(0, (*job).decompressedOut, blockLength) != loadU32(checksum))
+	{
+		fprintf(stderr, "Block %ld checksum does not match, the file is "
+			"corrupt.\n", (*job).blockIndex);
+		return 1;
 	}
-
-	printf("\n>Output complete.\n");
 
 	return 0;
 }
 
 /*******************************************************************************
- * This function inputs the characters of the input file into a char array.
+ * This function builds the code and decode tables from the table of the block
+ * at the given offset and returns the stored size of that table, or -1.
 *******************************************************************************/
-int getInputString(char *fileName, char *charArray)
+int readIndexedTable(const input_source_t *source, uint64_t offset, 
+	decode_table_t *table, symbol_code_t codeTable[256])
 {
-	printf("\n>Searching for %s  \n...\n", fileName);
-	FILE *fpIn;
-	fpIn = fopen(fileName, "r");
-	if(fpIn == NULL)
+	unsigned char buffer[BLOCK_HEADER_SIZE + MAX_BLOCK_TABLE_SIZE];
+	const unsigned char *data;
+	long available = readInputAt(source, buffer, sizeof(buffer), offset, 
+		&data);
+	if(available < BLOCK_HEADER_SIZE + 1 || 
+		(data[0] & BLOCK_FLAG_REUSE_TABLE))
 	{
-		fprintf(stderr, "Cannot open %s. File not found.\n", fileName);
+		fprintf(stderr, "Compressed data is corrupt.\n");
 		return -1;
-	}else
-	{
-		printf("File Located.\n");
-	}
-	fseek(fpIn, 0, SEEK_END);
-	int sz = ftell(fpIn);
-
-	printf("\n>File Data:\n - file size = %d bytes\n", sz);
-
-	fseek(fpIn,0, SEEK_SET);
-
-	int i;
-	for(i=0; i<sz; i++){
-		charArray[i] = fgetc(fpIn);
 	}
 
-	fclose(fpIn);
-
-	return strlen(charArray);
+	return (int)parseBlockTable(&data[BLOCK_HEADER_SIZE], 
+		available - BLOCK_HEADER_SIZE, table, codeTable);
 }
 
 /*******************************************************************************
- * This function countes the frequency of unique characters.
+ * This function builds the order-1 tables of the block at the given offset 
+ * and returns their stored size, or -1.
 *******************************************************************************/
-int uniqueCharsFreqCounter(char *inputString, int inputStringLength, 
-	char *uniqueChars, int *charFreq)
+long readIndexedOrder1Tables(const input_source_t *source, uint64_t offset, 
+	order1_tables_t *order1)
 {
-	int countUniqueChars = 0;
-	int i;
-	for(i=0; i<inputStringLength; i++)
+	unsigned char buffer[BLOCK_HEADER_SIZE + MAX_ORDER1_TABLES_SIZE];
+	const unsigned char *data;
+	long available = readInputAt(source, buffer, sizeof(buffer), offset, 
+		&data);
+	if(available < BLOCK_HEADER_SIZE)
 	{
-		int isUnique = 1; 
-		int j;
-		for(j=0; j<countUniqueChars; j++)
-		{
-			if(inputString[i] == uniqueChars[j])
-			{
-				isUnique = 0; 
-				charFreq[j]++;
-				break;
-			}
-		}
-		if(isUnique)
-		{
-			uniqueChars[countUniqueChars] = inputString[i];
-			countUniqueChars++;
-			charFreq[countUniqueChars -1 ] = 1;
-		}	
+		fprintf(stderr, "Compressed data is truncated.\n");
+		return -1;
 	}
-	return countUniqueChars;
+
+	return parseOrder1Tables(&data[BLOCK_HEADER_SIZE], 
+		available - BLOCK_HEADER_SIZE, order1);
 }
 
 /*******************************************************************************
- * This function creates the huffman tree.
+ * This function checks whether a stream is a regular file, which can be read
+ * and written at any offset.
 *******************************************************************************/
-void createHuffmanTree(node_t *nodeArray[], const int noOfUniqueChars)
+int isRegularFile(FILE *fp)
 {
+	struct stat info;
 
-	int smallest, secondSmall;
-	node_t *tmp;
-	int j;
-	for(j=0; j<(noOfUniqueChars-1); j++){
-		smallest = nextSmallestIndex(nodeArray, -1, noOfUniqueChars);
-		secondSmall = nextSmallestIndex(nodeArray,smallest,noOfUniqueChars);
-		tmp = nodeArray[smallest];
-		nodeArray[smallest] = malloc(sizeof(node_t));
-		(*nodeArray[smallest]).freq=(*nodeArray[secondSmall]).freq +(*tmp).freq;
-		(*nodeArray[smallest]).charIndex = -1; /*added nodes take index of -1 as 
-		a huffman code is not to be generated for them.*/
-		(*nodeArray[smallest]).largerFreq = nodeArray[secondSmall];
-		(*nodeArray[smallest]).smallerFreq = tmp;
-		(*nodeArray[secondSmall]).freq = -1;
-	}
+	return fstat(fileno(fp), &info) == 0 && S_ISREG(info.st_mode);
 }
 
 /*******************************************************************************
- * This function finds the index of the next smallest node value.
+ * This function checks the magic number and version of the file header and 
+ * returns its flags, checking the header's checksum when it has one.
 *******************************************************************************/
-int nextSmallestIndex(node_t *nodeArray[], int currentSmallestIndex, 
-	const int noOfUniqueChars)
+int readFileHeader(input_source_t *source, const compress_options_t *options,
+	int *flags)
 {
-
-	int nextSmallest; /*temporary variable holding the next smallest freq.*/
-	int nextSmallestIndex;
-
-	/*if currentSmallest value in array is at index 0, initialise nextSmallest 
-	to index 1, else to 0*/
-	if(currentSmallestIndex == 0)
-	{   
-		nextSmallest = (*nodeArray[1]).freq;
-		nextSmallestIndex = 1;
-	}
-	else
+	unsigned char headerBuffer[FILE_HEADER_SIZE];
+	const unsigned char *header;
+	if(readInput(source, headerBuffer, FILE_HEADER_SIZE, &header) != 
+		FILE_HEADER_SIZE || memcmp(header, FILE_MAGIC, FILE_MAGIC_SIZE) != 0)
 	{
-		nextSmallest = (*nodeArray[0]).freq;
-		nextSmallestIndex = 0;
+		fprintf(stderr, "Not a huffman compressed file.\n");
+		return 1;
 	}
-	
-	int i;
-	for(i=0;i<noOfUniqueChars;i++)
+	if(header[FILE_MAGIC_SIZE] != FORMAT_VERSION)
 	{
+		fprintf(stderr, "Unsupported format version %d.\n", 
+			header[FILE_MAGIC_SIZE]);
+		return 1;
+	}
 
-		/*ensure the currnet smallest index is not included in the comparison 
-		for the next smallest index*/
-		if(currentSmallestIndex == i)
-		{
-			i++;
-			if(i>(noOfUniqueChars-1))
-			{
-				return nextSmallestIndex;
-			}/*ensure index does not overflow*/
-		}
+	*flags = header[FILE_MAGIC_SIZE + 1];
+	uint32_t crc = crc32c(0, header, FILE_HEADER_SIZE);
 
-		/*ensure nextSmallest freq is not holding -1 as -1 is assigned to nodes
-		which have been parented in the tree. ie. not to be included again in 
-		the comparison.*/
-		while(nextSmallest == -1)
+	/****a file coded with a trained table names it by its ID.****/
+	uint32_t id = 0;
+	if(*flags & FILE_FLAG_DICTIONARY)
+	{
+		const unsigned char *idBytes;
+		if(readInput(source, headerBuffer, DICTIONARY_ID_SIZE, &idBytes) != 
+			DICTIONARY_ID_SIZE)
 		{
-			i++;
-			if(currentSmallestIndex == i)
-			{
-				i++;
-			}
-			if(i>(noOfUniqueChars-1))
-			{
-				return nextSmallestIndex;
-			}
-			nextSmallest = (*nodeArray[i]).freq;
-			nextSmallestIndex = i;
+			fprintf(stderr, "Compressed data is truncated.\n");
+			return 1;
 		}
-
-		/*ensure the current index which is to be compared with the temporary 
-		valiable is not holding -1*/
-		while((*nodeArray[i]).freq == -1)
+		id = loadU32(idBytes);
+		crc = crc32c(crc, idBytes, DICTIONARY_ID_SIZE);
+	}
+	if(*flags & FILE_FLAG_CHECKSUMS)
+	{
+		const unsigned char *checksum;
+		if(readInput(source, headerBuffer, CHECKSUM_SIZE, &checksum) != 
+			CHECKSUM_SIZE)
 		{
-			i++;
-			if(currentSmallestIndex == i){i++;}
-			if(i>(noOfUniqueChars-1)){return nextSmallestIndex;}
+			fprintf(stderr, "Compressed data is truncated.\n");
+			return 1;
 		}
-
-		/*compare value at current index with temporary variable*/
-		if((*nodeArray[i]).freq < nextSmallest)
+		if(loadU32(checksum) != crc)
 		{
-			nextSmallest = (*nodeArray[i]).freq;
-			nextSmallestIndex = i;
+			fprintf(stderr, "File header checksum does not match, the file is "
+				"corrupt.\n");
+			return 1;
 		}
 	}
-
-	return nextSmallestIndex;
+	if((*flags & FILE_FLAG_DICTIONARY) && ((*options).dictionary == NULL || 
+		(*(*options).dictionary).id != id))
+	{
+		fprintf(stderr, "The file was compressed with trained table %08x, "
+			"pass that table with -d.\n", (unsigned int)id);
+		return 1;
+	}
+	return 0;
 }
 
 /*******************************************************************************
- * This function uses the preorder tree algorithim (huffman code) to fill the
- * code array.   
+ * This function reads a block's table from the stream and builds its decode 
+ * tables.
 *******************************************************************************/
-void preorderGenerationOfHuffmanCode(node_t *tree, int huffmanCode[], 
-	int codeIndex, const int noOfUniqueChars, key_value_pair_t *codeArray[])
+int readBlockTable(input_source_t *source, decode_table_t *table, 
+	symbol_code_t codeTable[256])
 {
-	if((*tree).smallerFreq != NULL)
+	unsigned char entries[MAX_BLOCK_TABLE_SIZE];
+	const unsigned char *count;
+	const unsigned char *rest;
+	if(readInput(source, entries, 1, &count) != 1)
 	{
-		huffmanCode[codeIndex] = 1;
-		preorderGenerationOfHuffmanCode((*tree).smallerFreq, huffmanCode, 
-			codeIndex + 1, noOfUniqueChars, codeArray);
+		fprintf(stderr, "Compressed data is truncated.\n");
+		return 1;
 	}
-	if((*tree).largerFreq != NULL)
+	long tableSize = blockTableSize(count[0] + 1);
+	if(readInput(source, &entries[1], tableSize - 1, &rest) != tableSize - 1)
 	{
-		huffmanCode[codeIndex] = 0;
-		preorderGenerationOfHuffmanCode((*tree).largerFreq, huffmanCode, 
-			codeIndex + 1, noOfUniqueChars, codeArray);
+		fprintf(stderr, "Compressed data is truncated.\n");
+		return 1;
 	}
 
-	/*if node is a leaf node*/
-	if((*tree).charIndex != -1)
-	{
+	/*both reads land next to each other, in the map or in entries.*/
+	return parseBlockTable(count, tableSize, table, codeTable) < 0;
+}
 
-		/*char array to store hcode*/
-		char hc[codeIndex + 1];
+/*******************************************************************************
+ * This function parses a block's code lengths, assigns their canonical codes 
+ * and builds the decode tables straight from them. Returns the stored size of
+ * the table, or -1.
+*******************************************************************************/
+long parseBlockTable(const unsigned char *data, long available, 
+	decode_table_t *table, symbol_code_t codeTable[256])
+{
+	const unsigned char *entries = data;
+	int noOfUniqueChars = entries[0] + 1;
+	long tableSize = blockTableSize(noOfUniqueChars);
+	if(tableSize > available)
+	{
+		fprintf(stderr, "Compressed data is truncated.\n");
+		return -1;
+	}
 
-		if(noOfUniqueChars == 1)
+	/****mark the unique chars, then read their lengths in byte order.****/
+	memset(codeTable, 0, sizeof(symbol_code_t)*256);
+	long lengthsStart = 1 + TABLE_BITMAP_SIZE;
+	int i;
+	if(noOfUniqueChars < TABLE_BITMAP_SIZE)
+	{
+		for(i=0; i<noOfUniqueChars; i++)
 		{
-			hc[0] = '0';
+			codeTable[entries[1 + i]].length = -1;
 		}
-		else
+		lengthsStart = 1 + noOfUniqueChars;
+	}
+	else
+	{
+		for(i=0; i<256; i++)
 		{
-			int i;
-			for(i=0; i<codeIndex; i++)
+			if((entries[1 + (i >> 3)] >> (i & 7)) & 1)
 			{
-				sprintf(&hc[i], "%d", huffmanCode[i]); 
-			} 
+				codeTable[i].length = -1;
+			}
 		}
-		/*input null terminator*/
-		hc[codeIndex + 1] = '\0'; 
+	}
 
-		/*if charIndex of codeArray has not been set, set to huffman code.*/
-		if((*codeArray[(*tree).charIndex]).hCode == NULL)
+	bit_reader_t reader;
+	initBitReader(&reader, &entries[lengthsStart], tableSize - lengthsStart);
+	int marked = 0;
+	for(i=0; i<256; i++)
+	{
+		if(codeTable[i].length == -1)
 		{
-			(*codeArray[(*tree).charIndex]).hCode = malloc(sizeof(char)*
-														  (codeIndex + 1));
-			strcpy((*codeArray[(*tree).charIndex]).hCode, &hc[0]);
+			codeTable[i].length = (int)readBits(&reader, TABLE_LENGTH_BITS) + 1;
+			marked++;
 		}
 	}
+	if(marked != noOfUniqueChars || assignCanonicalCodes(codeTable))
+	{
+		fprintf(stderr, "Compressed data is corrupt.\n");
+		return -1;
+	}
 
-	return;
+	if(buildCodeDecodeTable(codeTable, table))
+	{
+		return -1;
+	}
+
+	return tableSize;
 }
 
 /*******************************************************************************
- * This function encodes the input string.
+ * This function reads a block's order-1 tables from the stream and builds 
+ * their decode tables.
 *******************************************************************************/
-int encodeString(char *inputString, int inputStringLength, char *compressedOut, 
-	const int noOfUniqueChars, key_value_pair_t *codeArray[])
-{ 
-	
-	int j;
-	for(j=0; j<inputStringLength; j++)
+int readOrder1Tables(input_source_t *source, order1_tables_t *order1)
+{
+	unsigned char buffer[1 + CONTEXT_MAP_SIZE];
+	const unsigned char *data;
+	if(readInput(source, buffer, 1 + CONTEXT_MAP_SIZE, &data) != 
+		1 + CONTEXT_MAP_SIZE)
 	{
-		int i;
-		for(i=0;i<noOfUniqueChars; i++)
+		fprintf(stderr, "Compressed data is truncated.\n");
+		return 1;
+	}
+	if(parseContextMap(data, order1))
+	{
+		return 1;
+	}
+	int g;
+	for(g=0; g<(*order1).groupCount; g++)
+	{
+		if(readBlockTable(source, &(*order1).decodeTables[g], 
+			(*order1).codeTables[g]))
 		{
-			if(inputString[j] == (*codeArray[i]).uniqueChar)
-			{
-				strcat(compressedOut, (*codeArray[i]).hCode);
-			}
+			return 1;
 		}
 	}
-	return strlen(compressedOut);
+
+	return 0;
 }
 
 /*******************************************************************************
- * This function decodes the compressed input file.
+ * This function parses a block's order-1 tables and builds their decode 
+ * tables. Returns their stored size, or -1.
 *******************************************************************************/
-int decodeString(char *compressedIn, int compressedInLength, 
-	char *decompressedOut, const int noOfUniqueChars, 
-	key_value_pair_t *codeArray[])
+long parseOrder1Tables(const unsigned char *data, long available, 
+	order1_tables_t *order1)
 {
-
-	char *tmpArray = malloc(sizeof(char)*(noOfUniqueChars-1));
-	*tmpArray = '\0';
-	*decompressedOut = '\0';
-	char charToCompare[2];
-	char charToAppend[2];
-	int j;
-	for(j=0; j<compressedInLength; j++)
+	if(available < 1 + CONTEXT_MAP_SIZE)
 	{
-		charToCompare[0] = compressedIn[j];
-		strcat(tmpArray, charToCompare);
-		int i;
-		for(i=0; i<noOfUniqueChars; i++)
-		{ 	
-			if(strcmp(tmpArray, (*codeArray[i]).hCode) == 0)
-			{
-				charToAppend[0] =  (*codeArray[i]).uniqueChar;
-				strcat(decompressedOut, charToAppend);
-				tmpArray = realloc(tmpArray, sizeof(char)*(noOfUniqueChars-1));
-				*tmpArray = '\0';
-			}
+		fprintf(stderr, "Compressed data is truncated.\n");
+		return -1;
+	}
+	if(parseContextMap(data, order1))
+	{
+		return -1;
+	}
+	long length = 1 + CONTEXT_MAP_SIZE;
+	int g;
+	for(g=0; g<(*order1).groupCount; g++)
+	{
+		long tableSize = length < available ? parseBlockTable(&data[length], 
+			available - length, &(*order1).decodeTables[g], 
+			(*order1).codeTables[g]) : -1;
+		if(tableSize < 0)
+		{
+			return -1;
 		}
+		length += tableSize;
 	}
 
-	return strlen(decompressedOut);
+	return length;
 }
 
 /*******************************************************************************
- * This function outputs the compressed string to a file.
+ * This function reads the group count and the group of each previous byte, 
+ * checking every group is one of the block's tables.
 *******************************************************************************/
-int outputCompressedString(char *compressedString, int compressedStringLength, 
-	char *outputFileName)
+int parseContextMap(const unsigned char *data, order1_tables_t *order1)
 {
-	FILE *fpOut;
-	fpOut = fopen(outputFileName, "w");
-	if(fpOut == NULL)
+	int groupCount = data[0];
+	if(groupCount < 2 || groupCount > MAX_CONTEXT_GROUPS)
 	{
-		fprintf(stderr, "output file cannot be opened.\n");
+		fprintf(stderr, "Compressed data is corrupt.\n");
 		return 1;
 	}
-	char buffer = '\0';
-	int count = 0;
-	char currentBit = '\0';
-	int e;
-	for(e=0; e<compressedStringLength; e++)
+	int i;
+	for(i=0; i<256; i++)
 	{
-		if(compressedString[e] == '0')
+		(*order1).groups[i] = (data[1 + i/2] >> (4*(i & 1))) & 15;
+		if((*order1).groups[i] >= groupCount)
 		{
-			currentBit = '\0';
-		}else if(compressedString[e] == '1')
-		{
-			currentBit = ('1' - '0');
-		}
-		buffer <<= 1;
-		buffer |= currentBit;
-		count++;
-		if(count == 8)
-		{
-			fwrite(&buffer, sizeof(char), 1, fpOut);
-			count = 0;
-			buffer = '\0';
-		}
-		if(e == (compressedStringLength - 1) && (count != 0))
-		{
-			buffer <<= (8 - count);
-			fwrite(&buffer, sizeof(char), 1, fpOut);
-			count = 0;
-			buffer = '\0';
+			fprintf(stderr, "Compressed data is corrupt.\n");
+			return 1;
 		}
 	}
-	fclose(fpOut);
+	(*order1).groupCount = groupCount;
 
 	return 0;
 }
 
 /*******************************************************************************
- * This function outputs the codes file to be used for decompression.
+ * This function names the output after the input. Compressing appends the 
+ * file extension, decompressing removes it or else appends the output 
+ * extension. Stdin maps to stdout. The name is allocated.
 *******************************************************************************/
-int outputCodes(key_value_pair_t *codeArray[], int noOfUniqueChars, 
-	int stringLength, char *outputFileName)
+char *defaultOutputName(const char *inputName, int compressing)
 {
-	FILE *fcodes;
-	fcodes = fopen(outputFileName,"w");
-	if(fcodes == NULL){
-		fprintf(stderr, "Cannot open file.");
-		return 1;
+	size_t length = strlen(inputName);
+	size_t extensionLength = strlen(FILE_EXTENSION);
+	char *outputName = malloc(sizeof(char)*(length + 
+		strlen(OUTPUT_EXTENSION) + extensionLength + 1));
+	if(outputName == NULL)
+	{
+		return NULL;
 	}
-	fwrite(&noOfUniqueChars, sizeof(int), 1, fcodes);
-	fwrite(&stringLength, sizeof(int), 1, fcodes);
 
-	int codeLengths[noOfUniqueChars];
-	int i;
-	for(i=0; i<noOfUniqueChars; i++){
-		codeLengths[i] = strlen((*codeArray[i]).hCode);
-		fwrite(&codeLengths[i], sizeof(int), 1, fcodes);
+	strcpy(outputName, inputName);
+	if(strcmp(inputName, "-") == 0)
+	{
+		return outputName;
 	}
-
-	int j;
-	for(j=0; j<noOfUniqueChars; j++){
-		fwrite(&((*codeArray[j]).uniqueChar), sizeof(char), 1, fcodes);
+	if(compressing)
+	{
+		strcat(outputName, FILE_EXTENSION);
 	}
-
-	int k;
-	for(k=0; k<noOfUniqueChars; k++){
-		fwrite((*codeArray[k]).hCode, codeLengths[k]*sizeof(char), 1, fcodes);
+	else if(length > extensionLength && 
+		strcmp(&inputName[length - extensionLength], FILE_EXTENSION) == 0)
+	{
+		outputName[length - extensionLength] = '\0';
+	}
+	else
+	{
+		strcat(outputName, OUTPUT_EXTENSION);
 	}
 
-	fclose(fcodes);
-	return 0;
+	return outputName;
 }
 
 /*******************************************************************************
- * This function decompresses the user selected file. Outputs decompressed file.
+ * This function opens the named input file, or stdin for -. A named regular 
+ * file is mapped so its blocks are read in place, any other input is read 
+ * with read().
 *******************************************************************************/
-int decompressFile(void)
+int openInputSource(input_source_t *source, const char *name)
 {
-	/*User enters the name of the file they wish to decompress*/
-	printf("Enter the name of the file you wish to decompress: \n");
-	char compressedFileName[100];
-	fgets(compressedFileName, sizeof(compressedFileName), stdin);
-	compressedFileName[strlen(compressedFileName)-1] = '\0'; /*clear \n*/
-	printf("\n>Searching for %s  \n...\n", compressedFileName);
-
-	/*open selected file*/
-	FILE *fpt;
-	fpt = fopen(compressedFileName, "r");
-	if(fpt == NULL)
+	(*source).fd = STDIN_FILENO;
+	(*source).map = NULL;
+	(*source).size = -1;
+	(*source).position = 0;
+	if(strcmp(name, "-") == 0)
 	{
-		fprintf(stderr,"Cannot open %s. File not found.\n", compressedFileName);
-		return 1;
-	}else{
-		printf("File located.\n");
+		return 0;
 	}
 
-	/****input noOfUniqueChars, original txt Length and codes.****/
-	int noOfUniqueCharsIn = 0;
-	int stringLengthIn = 0;
-	/*generate code file name*/
-	char *codeFileName = malloc((sizeof(char)*strlen(compressedFileName))+6);
-	generateCodeFileName(compressedFileName, strlen(compressedFileName), 
-						codeFileName);
-	printf("\n>Searching for %s  \n...\n", codeFileName);
-
-	/*open code file*/
-	FILE *fcodesIn;
-	fcodesIn = fopen(codeFileName, "r");
-	if(fcodesIn == NULL)
+	(*source).fd = open(name, O_RDONLY);
+	if((*source).fd < 0)
 	{
-		fprintf(stderr, "Cannot open %s. File not found.\n", codeFileName);
+		fprintf(stderr, "Cannot open %s. File not found.\n", name);
 		return 1;
-	}else
-	{
-		printf("File located.\n");
 	}
-	printf("\n>Fetching Huffman Codes Data\n...\n");
-	fread(&noOfUniqueCharsIn, sizeof(int), 1, fcodesIn);
-	fread(&stringLengthIn, sizeof(int), 1, fcodesIn);
-
-	key_value_pair_t *codeArrayIn[noOfUniqueCharsIn];
-	int il;
-	for(il=0;il<noOfUniqueCharsIn;il++){
-		codeArrayIn[il] = malloc(sizeof(key_value_pair_t));
-		(*codeArrayIn[il]).uniqueChar = ' ';
-		(*codeArrayIn[il]).hCode = NULL;
+	struct stat info;
+	if(fstat((*source).fd, &info) == 0 && S_ISREG(info.st_mode))
+	{
+		(*source).size = (int64_t)info.st_size;
 	}
 
-	int codeLengths[noOfUniqueCharsIn];
-	int i;
-	for(i=0; i<noOfUniqueCharsIn; i++){
-		fread(&codeLengths[i], sizeof(int), 1, fcodesIn);
+	/*an empty file cannot be mapped, and a file too large for the address 
+	space or a failed map falls back to read.*/
+	if((*source).size > 0 && (uint64_t)(*source).size <= SIZE_MAX)
+	{
+		void *map = mmap(NULL, (size_t)(*source).size, PROT_READ, MAP_PRIVATE, 
+			(*source).fd, 0);
+		if(map != MAP_FAILED)
+		{
+			posix_madvise(map, (size_t)(*source).size, POSIX_MADV_SEQUENTIAL);
+			(*source).map = map;
+		}
 	}
+	return 0;
+}
 
-	int j;
-	for(j=0; j<noOfUniqueCharsIn; j++){
-		fread(&((*codeArrayIn[j]).uniqueChar), sizeof(char), 1, fcodesIn);
+/*******************************************************************************
+ * This function returns the next length bytes of the input, fewer at the end.
+ * Mapped input is returned in place, otherwise it is read into the buffer. 
+ * Returns the number of bytes, or -1 on a read error.
+*******************************************************************************/
+long readInput(input_source_t *source, unsigned char *buffer, long length, 
+	const unsigned char **data)
+{
+	if((*source).map != NULL)
+	{
+		int64_t available = (*source).size - (*source).position;
+		if(length > available)
+		{
+			length = (long)available;
+		}
+		*data = &(*source).map[(*source).position];
+		(*source).position += length;
+		return length;
 	}
 
-	int k;
-	for(k=0; k<noOfUniqueCharsIn; k++){
-		(*codeArrayIn[k]).hCode = malloc(codeLengths[k]*sizeof(char));
-		fread((*codeArrayIn[k]).hCode, codeLengths[k]*sizeof(char),1,fcodesIn);
+	long total = 0;
+	while(total < length)
+	{
+		ssize_t count = read((*source).fd, &buffer[total], 
+			(size_t)(length - total));
+		if(count == 0)
+		{
+			break;
+		}
+		if(count < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			fprintf(stderr, "Cannot read input file.\n");
+			return -1;
+		}
+		total += count;
 	}
+	(*source).position += total;
+	*data = buffer;
+	return total;
+}
 
-	fclose(fcodesIn);
-
-	int f;
-	for(f=0;f<noOfUniqueCharsIn;f++)
+/*******************************************************************************
+ * This function returns up to length bytes of the input as soon as any are 
+ * ready, so a slow pipe is passed on without waiting for a full block. Mapped
+ * input is returned in place. Returns 0 at the end, or -1 on a read error.
+*******************************************************************************/
+long readAvailable(input_source_t *source, unsigned char *buffer, long length,
+	const unsigned char **data)
+{
+	if((*source).map != NULL)
 	{
-		printf("c: %c, code: %s\n", (*codeArrayIn[f]).uniqueChar, 
-			  (*codeArrayIn[f]).hCode);
+		return readInput(source, buffer, length, data);
 	}
 
-	printf("\n>Decompressing %s\n...\n", compressedFileName);
-	
-	/****input compressed txt file into a char array of binary values.****/
-	int maxLengthOfHCodeIn = noOfUniqueCharsIn-1;
-	char *compressedInputInBin = malloc(sizeof(char)*maxLengthOfHCodeIn*
-									   stringLengthIn);
-	if(compressedInputInBin == NULL)
+	ssize_t count;
+	do
 	{
-		fprintf(stderr, "Cannot input file. Memory allocation error.\n");
-		return 1;
+		count = read((*source).fd, buffer, (size_t)length);
 	}
-	int compressedInputInBinLen = inputCompressedFileToBinString(
-								  compressedFileName, compressedInputInBin);
-
-	/****decompress the binary array input****/
-	char *decompressedOutString = malloc(sizeof(char)*compressedInputInBinLen);
-	*decompressedOutString = '\0';
-
-	decodeString(compressedInputInBin, compressedInputInBinLen, 
-				decompressedOutString, noOfUniqueCharsIn, codeArrayIn);
-
-	decompressedOutString[stringLengthIn] = '\0';
-
-	/****output decompressed string into txt file****/
-	char *decompressedFileName = malloc(sizeof(char)*(strlen(compressedFileName)
-										+3));	
-	generateDecompressedFileName(compressedFileName, strlen(compressedFileName), 
-								decompressedFileName);
-	FILE *fpOutDecomp;
-	fpOutDecomp = fopen(decompressedFileName,"w");
-	if(fpOutDecomp == NULL)
+	while(count < 0 && errno == EINTR);
+	if(count < 0)
 	{
-		fprintf(stderr, "Cannot open output file.\n");
-		return 1;
+		fprintf(stderr, "Cannot read input file.\n");
+		return -1;
 	}
-	fwrite(decompressedOutString, sizeof(char)*strlen(decompressedOutString), 1, 
-		  fpOutDecomp);
-	fclose(fpOutDecomp);
-	
-	printf("Decompressed file written as %s\n", decompressedFileName);
-	printf("\n>Output complete.\n");
-	return 0;
+	(*source).position += count;
+	*data = buffer;
+	return (long)count;
 }
 
 /*******************************************************************************
- * This function generates the file name of the compressed text.
+ * This function returns length bytes of a regular input file from the given 
+ * offset, fewer at the end, without moving the sequential position. It is 
+ * safe to call from several threads at once.
 *******************************************************************************/
-int generateCompressedFileName(char *inputFileName, int inputFileNameLength, 
-	char *compressedFileName)
+long readInputAt(const input_source_t *source, unsigned char *buffer, 
+	long length, uint64_t offset, const unsigned char **data)
 {
-	strcpy(compressedFileName, inputFileName);
-	compressedFileName[inputFileNameLength - 4] = '\0';
-
-	char *appendName = "Compressed.txt";
-	strcat(compressedFileName, appendName);
+	if(offset >= (uint64_t)(*source).size)
+	{
+		return 0;
+	}
+	if(length > (*source).size - (int64_t)offset)
+	{
+		length = (long)((*source).size - (int64_t)offset);
+	}
+	if((*source).map != NULL)
+	{
+		*data = &(*source).map[offset];
+		return length;
+	}
 
-	return 0;
+	long total = 0;
+	while(total < length)
+	{
+		ssize_t count = pread((*source).fd, &buffer[total], 
+			(size_t)(length - total), (off_t)(offset + total));
+		if(count == 0)
+		{
+			break;
+		}
+		if(count < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			fprintf(stderr, "Cannot read input file.\n");
+			return -1;
+		}
+		total += count;
+	}
+	*data = buffer;
+	return total;
 }
 
 /*******************************************************************************
- * This function generates the file name of the codes.
+ * This function sets up an input source over a buffer already in memory.
 *******************************************************************************/
-int generateCodeFileName(char *compressedFileName, int compressedFileNameLength, 
-	char *codeFileName)
+void memoryInputSource(input_source_t *source, const unsigned char *data, 
+	long length)
 {
-	strcpy(codeFileName, compressedFileName);
-	codeFileName[compressedFileNameLength - 4] = '\0';
-
-	char *appendName = "Codes.txt";
-	strcat(codeFileName, appendName);
-
-	return 0;
+	(*source).fd = -1;
+	(*source).map = data;
+	(*source).size = length;
+	(*source).position = 0;
 }
 
 /*******************************************************************************
- * This function generates the decompressed file name.
+ * This function unmaps and closes an input, leaving stdin open.
 *******************************************************************************/
-int generateDecompressedFileName(char *compressedFileName, 
-	int compressedFileNameLength, char *decompressedFileName)
+void closeInputSource(input_source_t *source)
 {
-	strcpy(decompressedFileName, compressedFileName);
-	decompressedFileName[compressedFileNameLength - 14] = '\0';
-
-	char *appendName = "Decompressed.txt";
-	strcat(decompressedFileName, appendName);
-
-	return 0;
+	if((*source).map != NULL)
+	{
+		munmap((void *)(*source).map, (size_t)(*source).size);
+		(*source).map = NULL;
+	}
+	if((*source).fd != STDIN_FILENO)
+	{
+		close((*source).fd);
+	}
 }
 
 /*******************************************************************************
- * This function inouts the compressd file into a binary string.
+ * This function opens the named output file, or stdout for -.
 *******************************************************************************/
-int inputCompressedFileToBinString(char *compressedFileName, 
-	char *compressedInputInBin)
+FILE *openOutput(const char *name)
 {
-	FILE *fpOutIn;
-	fpOutIn = fopen(compressedFileName, "r");
-	if(fpOutIn == NULL)
+	if(strcmp(name, "-") == 0)
 	{
-		fprintf(stderr, "Cannot open input file.\n");
-		return 1;
+		return stdout;
 	}
 
-	fseek(fpOutIn, 0, SEEK_END);
-	fseek(fpOutIn, 0, SEEK_SET);
-
-	int c;
-	int g;
-	*compressedInputInBin = '\0';
-	char compressedInput[] = "\0";
-	char buff[] = "\0";
-	c = fgetc(fpOutIn);
-	while(c != EOF)
+	FILE *fp = fopen(name, "wb");
+	if(fp == NULL)
 	{
-		compressedInput[0] = reverseBitsInByte(c);
-		for(g=0; g<8; g++)
-		{
-			buff[0] = compressedInput[0] & 1;
-			if(buff[0] == '\0')
-			{
-				buff[0] = '0';
-			}else if(buff[0] == ('1' - '0'))
-			{
-				buff[0] = '1';
-			}
-			strcat(compressedInputInBin, buff);
-			compressedInput[0] >>= 1;
-		}
-		c = fgetc(fpOutIn);
+		fprintf(stderr, "Cannot open output file %s.\n", name);
 	}
-	fclose(fpOutIn);
-
-	return strlen(compressedInputInBin);
+	return fp;
 }
 
 /*******************************************************************************
- * This function reverses the bits in the input byte.
+ * This function closes the files of a command, leaving stdin and stdout open
+ * with stdout flushed. A failed command removes the partial output file. 
+ * Returns the status including any error on closing.
 *******************************************************************************/
-char reverseBitsInByte(char byte)
+int closeFiles(input_source_t *source, FILE *fpOut, const char *outputName, 
+	int status)
 {
-	char reversedByte = '\0';
-	int i;
-	for(i=0; i<7; i++)
+	if(source != NULL)
+	{
+		closeInputSource(source);
+	}
+	if(fpOut == NULL)
+	{
+		return status;
+	}
+
+	if((fpOut == stdout ? fflush(fpOut) : fclose(fpOut)) != 0)
+	{
+		fprintf(stderr, "Cannot write output file.\n");
+		status = 1;
+	}
+	if(status && fpOut != stdout)
 	{
-		reversedByte += (1 & byte);
-		reversedByte <<= 1;
-		byte >>= 1;
+		remove(outputName);
 	}
-	reversedByte += (1 & byte);
-	return reversedByte;
+	return status;
 }